@@ -1,5 +1,113 @@
 #include "mini_git.hpp"
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace minigit;
+
+//the library returns data; everything below only formats it
+
+bool failed(const Error& error) {
+    if (error.code == ErrorCode::None) return false;
+    if (error.code == ErrorCode::NoCommits) std::cout << error.message << "\n";
+    else std::cout << "Error: " << error.message << "\n";
+    return true;
+}
+
+void printMerge(const MergeResult& result) {
+    for (const auto& file : result.conflicts) std::cout << "CONFLICT: " << file << "\n";
+    if (!result.commit.empty()) std::cout << "Merge commit: " << result.commit << "\n";
+}
+
+void printNameStatus(const std::vector<FileDiff>& changes) {
+    for (const auto& c : changes) {
+        if (c.status == 'R' || c.status == 'C') {
+            std::cout << c.status << std::setw(3) << std::setfill('0') << c.similarity << std::setfill(' ')
+                      << "\t" << c.oldPath << "\t" << c.path << "\n";
+        } else {
+            std::cout << c.status << "\t" << c.path << "\n";
+        }
+    }
+}
+
+void printStat(const std::vector<FileDiff>& changes) {
+    size_t insertions = 0, deletions = 0, widest = 0, largest = 0;
+    auto nameOf = [](const FileDiff& c) { return c.oldPath.empty() ? c.path : c.oldPath + " => " + c.path; };
+    for (const auto& c : changes) {
+        insertions += c.inserted;
+        deletions += c.deleted;
+        largest = std::max(largest, c.inserted + c.deleted);
+        widest = std::max(widest, nameOf(c).size());
+    }
+
+    //scale the +/- bar so the biggest change fits in 40 columns
+    const size_t barWidth = 40;
+    for (const auto& c : changes) {
+        std::cout << " " << std::left << std::setw(widest) << nameOf(c) << std::right << " | ";
+        if (c.binary) {
+            std::cout << "Bin " << c.oldSize << " -> " << c.newSize << " bytes\n";
+            continue;
+        }
+        size_t total = c.inserted + c.deleted;
+        size_t plus = c.inserted, minus = c.deleted;
+        if (largest > barWidth && total > 0) {
+            plus = c.inserted * barWidth / largest;
+            minus = c.deleted * barWidth / largest;
+            if (c.inserted && !plus) plus = 1;
+            if (c.deleted && !minus) minus = 1;
+        }
+        std::cout << total << (total ? " " : "") << std::string(plus, '+') << std::string(minus, '-') << "\n";
+    }
+    std::cout << " " << changes.size() << " file" << (changes.size() == 1 ? "" : "s") << " changed, "
+              << insertions << " insertion" << (insertions == 1 ? "" : "s") << "(+), "
+              << deletions << " deletion" << (deletions == 1 ? "" : "s") << "(-)\n";
+}
+
+void printHunks(const std::vector<FileDiff>& changes) {
+    for (const auto& c : changes) {
+        if (c.status == 'R' || c.status == 'C') {
+            std::cout << "===File:" << c.oldPath << " -> " << c.path << " (" << (c.status == 'C' ? "copied" : "renamed")
+                      << ", " << c.similarity << "% similar)===\n";
+        } else {
+            std::cout << "===File:" << c.path << "===\n";
+        }
+        if (c.binary) {
+            std::cout << "Binary files differ\n\n";
+            continue;
+        }
+        for (const auto& h : c.hunks) {
+            std::cout << "Line " << h.newStart + 1 << ":\n";
+            for (size_t i = h.oldStart; i < h.oldStart + h.oldCount; ++i) std::cout << " -" << c.oldLines[i] << "\n";
+            for (size_t i = h.newStart; i < h.newStart + h.newCount; ++i) std::cout << " +" << c.newLines[i] << "\n";
+        }
+        std::cout << "\n";
+    }
+}
+
+void printCheckout(const CheckoutResult& result) {
+    for (const auto& file : result.files) {
+        if (file.restored) std::cout << "Restored: " << file.path << "\n";
+        else std::cout << "Error: blob not found for file: " << file.path << "\n";
+    }
+    for (const auto& name : result.removed) std::cout << "Removed: " << name << "\n";
+    if (result.skipped) std::cout << result.skipped << " files outside the sparse-checkout patterns.\n";
+}
+
+void printFetched(const FetchResult& result) {
+    for (const auto& hash : result.corrupt) std::cout << "Error: corrupt object " << hash << " in pack.\n";
+    std::cout << "Received " << result.commits << " commits and " << result.objects << " objects ("
+              << result.bytes << " bytes).\n";
+}
+
+const char* stateName(FileState state) {
+    switch (state) {
+        case FileState::New: return "new file:  ";
+        case FileState::Modified: return "modified:  ";
+        case FileState::Deleted: return "deleted:   ";
+        default: return "unchanged: ";
+    }
+}
 
 int main() {
     MiniGitRepo repo;
@@ -9,12 +117,34 @@ int main() {
     std::cin >> command;
 
     if (command == "init") {
-        repo.init();
+        Result<std::string> result = repo.init();
+        if (!failed(result.error)) {
+            std::cout << "Initialized empty MiniGit repository in" << std::quoted(result.value) << "\n";
+        }
     }
     else if ( command=="add"){
-        std::string filename;
-        std::cin>>filename;
-        repo.add(filename);
+        //add <file or dir>...; directories are walked honouring .minigitignore, and all
+        //files go through one read/hash/store pipeline
+        std::string rest, filename;
+        std::vector<std::string> filenames;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        while (args >> filename) filenames.push_back(filename);
+        Result<std::vector<AddResult>> result = repo.add(filenames);
+        if (!failed(result.error)) {
+            for (const auto& added : result.value) {
+                if (added.removed) {
+                    std::cout << "Staged removal: " << added.path << "\n";
+                    continue;
+                }
+                if (added.chunks) {
+                    std::cout << "Chunked into " << added.chunks << " chunks (" << added.newChunks << " new).\n";
+                }
+                if (added.stored) std::cout << "Added blob: " << added.blob << "\n";
+                else std::cout << "Blob alraedy exists. Skipping file copy.\n";
+                std::cout << "Staged file: " << added.path << "\n";
+            }
+        }
     }
     else if(command=="commit"){
         std::string flag;
@@ -22,37 +152,283 @@ int main() {
         if(flag == "-m"){
             std::string message;
             std::getline(std::cin>>std::ws, message);
-            repo.commit(message);
+            Result<CommitResult> result = repo.commit(message);
+            if (!failed(result.error)) {
+                for (const auto& name : result.value.removed) {
+                    std::cout << "Removed: " << name << "\n";
+                }
+                for (const auto& name : result.value.skipped) {
+                    std::cout << "Warning: File '" << name << "' was staged but no longer exists. Skipping.\n";
+                }
+                std::cout << "Index cleared after commit.\n";
+            }
         }else{
             std::cout<<"usage: commit -m\"message\"\n";
         }
     }
     else if(command == "log"){
-        repo.log();
+        //optional "-- <path>" limits the history to commits touching path,
+        //"--grep <words>" and "--author <name>" to commits whose message/author has those words
+        std::string rest, word, path, grep, author;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        std::string* target = nullptr;
+        while(args>> word){
+            if(word == "--") args>> path;
+            else if(word == "--grep") target = &grep;
+            else if(word == "--author") target = &author;
+            else if(target) *target += (target->empty() ? "" : " ") + word;
+        }
+        Result<CommitIterator> result = repo.log(LogFilter{path, grep, author});
+        if (!failed(result.error)) {
+            CommitInfo info;
+            while (result.value.next(info)) {
+                std::cout << "-------------------------------\n";
+                std::cout << "Commit Hash: " << info.hash << "\n";
+                std::cout << "Message:      " << info.message << "\n";
+                if (!info.author.empty()) std::cout << "Author:       " << info.author << "\n";
+                std::cout << "Timestamp:    " << info.timestamp << "\n";
+                std::cout << "-------------------------------\n";
+            }
+            failed(result.value.error());
+        }
     }
     else if(command =="branch"){
         std::string branchName;
         std::cin>>branchName;
-        repo.branch(branchName);
+        Result<std::string> result = repo.branch(branchName);
+        if (!failed(result.error)) {
+            std::cout << "Branch '" << branchName << "'created at commit" << result.value << "\n";
+        }
     }
     else if(command == "checkout"){
         std::string branchName;
         std::cin>>branchName;
-        repo.checkout(branchName);
+        Result<CheckoutResult> result = repo.checkout(branchName);
+        if (!failed(result.error)) {
+            std::cout << "Switched to branch '" << branchName << "'\n";
+            if (result.value.commit.empty()) std::cout << "No commits on this branch yet.\n";
+            printCheckout(result.value);
+        }
+    }
+    else if (command == "worktree") {
+        //worktree add <path> <branch> | list
+        std::string action, path, branchName;
+        std::cin >> action;
+        if (action == "add") {
+            std::cin >> path >> branchName;
+            Result<CheckoutResult> result = repo.addWorktree(path, branchName);
+            if (!failed(result.error)) {
+                std::cout << "Worktree '" << path << "' created on branch '" << branchName << "'\n";
+                printCheckout(result.value);
+            }
+        } else if (action == "list") {
+            Result<std::vector<WorktreeInfo>> result = repo.worktrees();
+            if (!failed(result.error)) {
+                for (const auto& tree : result.value) std::cout << tree.path << "  [" << tree.branch << "]\n";
+            }
+        } else {
+            std::cout << "usage: worktree add <path> <branch> | list\n";
+        }
+    }
+    else if (command == "sparse-checkout") {
+        //sparse-checkout set <pattern>... | list | disable
+        std::string action, rest, pattern;
+        std::cin >> action;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        std::vector<std::string> patterns;
+        while (args >> pattern) patterns.push_back(pattern);
+        if (action == "list") {
+            for (const auto& p : repo.sparsePatterns()) std::cout << p << "\n";
+        } else if (action == "set" || action == "disable") {
+            if (action == "disable") patterns.clear();
+            Result<CheckoutResult> result = repo.setSparsePatterns(patterns);
+            if (!failed(result.error)) printCheckout(result.value);
+        } else {
+            std::cout << "usage: sparse-checkout set <pattern>... | list | disable\n";
+        }
     }
     else if(command =="merge"){
         std::string branchName;
         std::cin>> branchName;
-        repo.merge(branchName);
+        Result<MergeResult> result = repo.merge(branchName);
+        if (!failed(result.error)) {
+            std::cout << "LCA: " << result.value.base << "\n";
+            for (const auto& note : result.value.renames) std::cout << "Renamed: " << note << "\n";
+            for (const auto& file : result.value.conflicts) std::cout << "CONFLICT: both modifies" << file << "\n";
+            std::cout << "Merge complete. New commit: " << result.value.commit << "\n";
+        }
     }
     else if (command=="diff") {
-        std::string c1, c2;
-        std::cin >> c1 >> c2;
-        repo.diff(c1, c2);
+        //optional --stat or --name-status before the two commits
+        std::string rest, word, mode;
+        std::vector<std::string> commits;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        while (args >> word) {
+            if (word.rfind("--", 0) == 0) mode = word;
+            else commits.push_back(word);
+        }
+        commits.resize(2);
+        DiffDetail detail = mode == "--stat" ? DiffDetail::Counts :
+                            mode == "--name-status" ? DiffDetail::Names : DiffDetail::Hunks;
+        if (!mode.empty() && mode != "--stat" && mode != "--name-status") {
+            std::cout << "Unknown diff mode '" << mode << "'.\n";
+        } else {
+            Result<std::vector<FileDiff>> result = repo.diff(commits[0], commits[1], detail);
+            if (!failed(result.error)) {
+                if (detail == DiffDetail::Names) printNameStatus(result.value);
+                else if (detail == DiffDetail::Counts) printStat(result.value);
+                else printHunks(result.value);
+            }
+        }
+    }
+    else if (command=="status") {
+        Result<StatusReport> result = repo.status();
+        if (!failed(result.error)) {
+            const StatusReport& report = result.value;
+            std::cout << "On commit " << report.head << "\n";
+            std::cout << "Changes staged for commit:\n";
+            for (const auto& entry : report.staged) std::cout << "  " << stateName(entry.state) << entry.path << "\n";
+            std::cout << "Changes not staged for commit:\n";
+            for (const auto& entry : report.unstaged) std::cout << "  " << stateName(entry.state) << entry.path << "\n";
+            std::cout << "Untracked files:\n";
+            for (const auto& name : report.untracked) std::cout << "  " << name << "\n";
+        }
+    }
+    else if (command=="fsmonitor") {
+        std::string action;
+        std::cin >> action;
+        Result<FsmonitorState> result = repo.fsmonitor(action);
+        if (!failed(result.error)) {
+            const FsmonitorState& state = result.value;
+            if (action == "start") std::cout << "fsmonitor started (pid " << state.pid << ").\n";
+            else if (action == "stop") std::cout << "fsmonitor stopped.\n";
+            else if (state.running) std::cout << "fsmonitor is running, token " << state.token << "\n";
+            else std::cout << "fsmonitor is not running.\n";
+        }
+    }
+    else if (command=="prune") {
+        //optional "--expire <seconds>", unreachable objects younger than that are kept
+        std::string rest, word;
+        long long expire = 14LL * 24 * 60 * 60;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        while(args>> word){
+            if(word == "--expire") args>> expire;
+        }
+        Result<PruneReport> result = repo.prune(expire);
+        if (!failed(result.error)) {
+            const PruneReport& report = result.value;
+            std::cout << "Reachable objects: " << report.reachable << "\n";
+            std::cout << "Unreachable objects: " << report.unreachable << " (" << report.kept
+                      << " kept inside the grace period)\n";
+            std::cout << "Pruned " << report.pruned << " objects.\n";
+        }
+    }
+    else if (command=="fsck") {
+        Result<FsckReport> result = repo.fsck();
+        if (!failed(result.error)) {
+            const FsckReport& report = result.value;
+            for (const auto& line : report.problems) std::cout << line << "\n";
+            for (const auto& hash : report.danglingCommits) std::cout << "dangling commit " << hash << "\n";
+            for (const auto& hash : report.danglingObjects) std::cout << "dangling object " << hash << "\n";
+            std::cout << "Checked " << report.objects << " objects and " << report.commits << " commits: "
+                      << report.problems.size() << " problems, "
+                      << report.danglingCommits.size() + report.danglingObjects.size() << " dangling.\n";
+        }
+    }
+    else if (command=="clone") {
+        std::string source;
+        std::cin >> source;
+        Result<CloneResult> result = repo.clone(source);
+        if (!failed(result.error)) {
+            printFetched(result.value.fetched);
+            std::cout << "Cloned " << result.value.branches << " branches from " << source << "\n";
+            if (!result.value.head.empty()) {
+                std::cout << "Switched to branch '" << result.value.head << "'\n";
+                printCheckout(result.value.checkout);
+            }
+        }
+    }
+    else if (command=="fetch") {
+        std::string source, branchName;
+        std::cin >> source >> branchName;
+        Result<FetchResult> result = repo.fetch(source, branchName);
+        if (!failed(result.error)) {
+            printFetched(result.value);
+            if (result.value.fastForward) {
+                std::cout << "Branch '" << branchName << "' updated to " << result.value.tip << "\n";
+            } else {
+                std::cout << "Branch '" << branchName << "' has diverged; fetched tip " << result.value.tip
+                          << " stored in FETCH_HEAD.\n";
+            }
+        }
+    }
+    else if (command=="blame") {
+        std::string filename;
+        std::cin >> filename;
+        Result<std::vector<BlameLine>> result = repo.blame(filename);
+        if (!failed(result.error)) {
+            for (size_t i = 0; i < result.value.size(); ++i) {
+                const BlameLine& line = result.value[i];
+                std::cout << std::left << std::setw(16) << line.commit << " " << std::right << std::setw(5) << i + 1
+                          << ") " << line.text << "\n";
+            }
+        }
+    }
+    else if (command=="grep") {
+        //grep <pattern> [commit], HEAD by default
+        std::string pattern, rest, commit;
+        std::cin >> pattern;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        args >> commit;
+        Result<std::vector<GrepMatch>> result = repo.grep(pattern, commit);
+        if (!failed(result.error)) {
+            for (const auto& match : result.value) {
+                if (match.binary) std::cout << "Binary file " << match.path << " matches\n";
+                else std::cout << match.path << ":" << match.line << ":" << match.text << "\n";
+            }
+        }
+    }
+    else if (command=="merge-tree") {
+        std::string ours, theirs;
+        std::cin >> ours >> theirs;
+        Result<MergeResult> result = repo.mergeTree(ours, theirs);
+        if (!failed(result.error)) printMerge(result.value);
+    }
+    else if (command=="cherry-pick") {
+        //optional target branch, the current branch by default
+        std::string commit, rest, branchName;
+        std::cin >> commit;
+        std::getline(std::cin, rest);
+        std::stringstream args(rest);
+        args >> branchName;
+        Result<MergeResult> result = repo.cherryPick(commit, branchName);
+        if (!failed(result.error)) {
+            if (result.value.commit.empty()) {
+                for (const auto& file : result.value.conflicts) std::cout << "CONFLICT: " << file << "\n";
+                std::cout << "Cherry-pick of " << commit << " aborted, nothing was written.\n";
+            } else {
+                std::cout << "Cherry-picked " << commit << " as " << result.value.commit << "\n";
+            }
+        }
+    }
+    else if (command=="migrate-objects") {
+        Result<MigrateReport> result = repo.migrateObjects();
+        if (!failed(result.error)) {
+            const MigrateReport& report = result.value;
+            if (!report.total) std::cout << "Object store already uses the fan-out layout.\n";
+            else std::cout << "Migrated " << report.moved << " of " << report.total << " objects into fan-out directories.\n";
+        }
     }
     else{
         std::cout << "Unknown command\n";
     }
 
+    const Error& recovery = repo.recoveryWarning();
+    if (recovery.code != ErrorCode::None) std::cerr << "warning: " << recovery.message << "\n";
     return 0;
 }
\ No newline at end of file
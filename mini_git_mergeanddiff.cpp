@@ -10,34 +10,145 @@
 #include<set>
 #include<iomanip>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <array>
+#include <charconv>
+#include <regex>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <cerrno>
 
 namespace fs = std::filesystem;
 
-void MiniGitRepo::init(){
+namespace minigit{
+
+//the error every command returns when run outside a repository
+static Error notARepository(){
+    return Error{ErrorCode::NotARepository, "not a MiniGit repository."};
+}
+
+//find the repository of the current directory; paths are absolute so that a journal
+//written from one worktree can be replayed from any other
+RepoDirs locateRepository(){
+    std::string entry = fs::absolute(".minigit").lexically_normal().string();
+    RepoDirs dirs{entry, entry, false};
+    if(!fs::is_regular_file(entry)) return dirs;
+
+    std::ifstream in(entry);
+    std::string line;
+    const std::string prefix = "minigitdir: ";
+    if(!std::getline(in, line) || line.rfind(prefix, 0) != 0) return dirs;
+    fs::path worktree = fs::path(line.substr(prefix.size())).lexically_normal();
+    dirs.worktree = worktree.string();
+    dirs.common = worktree.parent_path().parent_path().string(); //<common>/worktrees/<name>
+    dirs.linked = true;
+    return dirs;
+}
+
+MiniGitRepo::MiniGitRepo() : MiniGitRepo(locateRepository()){}
+
+MiniGitRepo::MiniGitRepo(const RepoDirs& dirs) : dirs(dirs){
+    //finish or discard a group flush that was interrupted by a crash; while another
+    //process holds the lock the journal is its flush in progress, so leave it alone
+    if(fs::exists(journalFile) && acquireLock(false)){
+        recoverJournal();
+        releaseLock();
+    }
+}
+
+MiniGitRepo::~MiniGitRepo(){
+    flushJournal();
+    releaseLock();
+}
+
+/*
+ Locking model: one writer at a time holds an flock on .minigit/lock until it exits,
+ so the kernel drops it if the writer crashes. Writers publish every file by rename
+ through the journal (objects first, then refs, HEAD and the index), so readers take
+ no lock at all and each file they open is either the old or the new version.
+*/
+bool MiniGitRepo::acquireLock(bool wait){
+    if(lockFd >= 0) return true;
+    int fd = ::open(lockFile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) return false;
+    if(::flock(fd, LOCK_EX | LOCK_NB) != 0){
+        if(!wait || errno != EWOULDBLOCK){
+            ::close(fd);
+            return false;
+        }
+        if(::flock(fd, LOCK_EX) != 0){
+            ::close(fd);
+            return false;
+        }
+    }
+    lockFd = fd;
+    return true;
+}
+
+void MiniGitRepo::releaseLock(){
+    if(lockFd < 0) return;
+    ::flock(lockFd, LOCK_UN);
+    ::close(lockFd);
+    lockFd = -1;
+}
+
+//called first by every command that changes the repository; a no-op outside one
+Error MiniGitRepo::lockForWrite(){
+    if(lockFd >= 0 || !fs::exists(baseDir)) return Error();
+    if(!acquireLock(true)){
+        return Error{ErrorCode::LockFailed, "could not lock " + lockFile + ": " + std::strerror(errno)};
+    }
+    //a writer that crashed while this one waited may have left its journal behind
+    if(fs::exists(journalFile)){
+        recoverJournal();
+    }
+    return Error();
+}
+
+Result<std::string> MiniGitRepo::init(){
     if (fs::exists(baseDir)){
-        std::cout<<"MiniGit is already initialized.\n";
-        return;
+        return Error{ErrorCode::AlreadyExists, "MiniGit is already initialized."};
     }
 
     //create .mingit structure
     fs::create_directory(baseDir);
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
     fs::create_directory(objectsDir);
     fs::create_directory(refsDir);
+    objectIndex.rebuild({});
+    commitIndex.rebuild({});
+    logIndex.rebuild({});
 
     //create Head file pointing to main branch
-    std::ofstream head(headFile);
-    head<<"ref: refs/main\n";
-    head.close();
+    journalRef(headFile, "ref: refs/main\n");
 
     //create empty main branch ref file
-    std::ofstream mainRef(mainRefFile);
-    mainRef << "null";
-    mainRef.close();
+    journalRef(mainRefFile, "null");
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
 
-    std::cout<< "Initialized empty MiniGit repository in" << fs::absolute(baseDir) <<"\n";
+    return fs::absolute(baseDir).string();
 }
 
-std::string computeHash(const std::string& content){
+static std::string computeHash(const std::string& content){
     std::hash<std::string> hasher;
     size_t hash = hasher( content);
     std::stringstream ss;
@@ -45,478 +156,4491 @@ std::string computeHash(const std::string& content){
     return ss.str();
 }
 
-void MiniGitRepo::add(const std::string& filename){
-    if(!fs::exists(filename)){
-        std::cout<<"Error: File '"<< filename<<"'does not exist.\n";
-        return;
+//write a whole buffer with plain POSIX calls (no fsync, the group flush syncs once)
+static bool writeWholeFile(const std::string& path, const std::string& content){
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+    const char* data = content.data();
+    size_t left = content.size();
+    while(left > 0){
+        ssize_t n = ::write(fd, data, left);
+        if(n < 0){
+            ::close(fd);
+            return false;
+        }
+        data += n;
+        left -= n;
     }
+    return ::close(fd) == 0;
+}
 
-    //Read file content
-    std::ifstream inFile(filename);
-    std::stringstream buffer;
-    buffer<< inFile.rdbuf();
-    std::string content = buffer.str();
+//flush every dirty page of the filesystem holding dir with a single call
+static bool syncFilesystem(const std::string& dir){
+#ifdef __linux__
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd >= 0){
+        bool synced = ::syncfs(fd) == 0;
+        ::close(fd);
+        return synced;
+    }
+#endif
+    ::sync();
+    return true;
+}
 
-    std::string hash= computeHash(content);
-    std::string blobPath = objectsDir + "/" + hash;
+//object names are the hex form of a 64-bit hash, so the index stores them as integers
+static bool parseObjectId(const std::string& hex, uint64_t& id){
+    if(hex.empty() || hex.size() > 16 || hex.find_first_not_of("0123456789abcdef") != std::string::npos) return false;
+    id = std::stoull(hex, nullptr, 16);
+    return true;
+}
 
-    //store blob if it doesn`t exist
-    if (!fs::exists(blobPath)){
-        std::ofstream out(blobPath);
-        out<<content;
-        out.close();
-        std::cout<<"Added blob: "<< hash <<"\n";
-    }else{
-        std::cout<<"Blob alraedy exists. Skipping file copy.\n";
+static std::string formatObjectId(uint64_t id){
+    std::stringstream ss;
+    ss<< std::hex << id;
+    return ss.str();
+}
+
+static uint64_t mixId(uint64_t x){
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ objects.idx layout (native endian):
+   char[4] "MGIX", u32 version, u64 count, u64 bloomBits, u32 hashCount, u32 unused
+   bloom bitmap (bloomBits / 8 bytes)
+   count sorted u64 object IDs
+ objects.idx.log holds u64 IDs written since the last rebuild; their bits are also
+ set in the mapped bloom so a negative answer stays authoritative.
+*/
+const size_t objectIndexHeaderSize = 32;
+
+ObjectIdIndex::ObjectIdIndex(const std::string& indexPath)
+    : path(indexPath), logPath(indexPath + ".log"){}
+
+ObjectIdIndex::~ObjectIdIndex(){
+    close();
+}
+
+void ObjectIdIndex::close(){
+    if(map) ::munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    count = 0;
+    bloomBits = 0;
+    hashCount = 0;
+    logIds.clear();
+    opened = false;
+}
+
+bool ObjectIdIndex::open(){
+    if(opened) return true;
+    int fd = ::open(path.c_str(), O_RDWR);
+    if(fd < 0) return false;
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || (size_t)st.st_size < objectIndexHeaderSize){
+        ::close(fd);
+        return false;
     }
+    void* mem = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) return false;
 
-    //Append filename to index if not already staged
-    std::ifstream indexcheck(baseDir + "/index");
-    std::string line;
-    bool alreadyStaged = false;
-    while (std::getline(indexcheck,line)){
-        if(line == filename){
-            alreadyStaged = true;
-            break;
-        }
+    map = static_cast<unsigned char*>(mem);
+    mapSize = st.st_size;
+    uint32_t version;
+    std::memcpy(&version, map + 4, 4);
+    std::memcpy(&count, map + 8, 8);
+    std::memcpy(&bloomBits, map + 16, 8);
+    std::memcpy(&hashCount, map + 24, 4);
+    if(std::memcmp(map, "MGIX", 4) != 0 || version != 1 || bloomBits == 0 ||
+       objectIndexHeaderSize + bloomBits / 8 + count * 8 != mapSize){
+        close();
+        return false;
     }
-    indexcheck.close();
 
-    if(!alreadyStaged){
-        std::ofstream indexOut(baseDir + "/index", std::ios::app);
-        indexOut<< filename<<"\n";
-        indexOut.close();
+    std::ifstream logIn(logPath, std::ios::binary);
+    uint64_t id;
+    while(logIn.read(reinterpret_cast<char*>(&id), sizeof(id))){
+        logIds.push_back(id);
     }
-    std::cout<<"Staged file: "<< filename<<"\n";
+    std::sort(logIds.begin(), logIds.end());
+    opened = true;
+    return true;
 }
 
-void MiniGitRepo::commit(const std::string& message){
-    //HEAD -> refs/main -> current commit hash
-    std::ifstream headIn(headFile);
-    std::string headRef;
-    std::getline(headIn,headRef);
-    headIn.close();
+unsigned char* ObjectIdIndex::bloom() const{
+    return map + objectIndexHeaderSize;
+}
 
-    std::string branch = headRef.substr(5);
-    std::string branchPath= baseDir + "/" + branch;
+const uint64_t* ObjectIdIndex::table() const{
+    return reinterpret_cast<const uint64_t*>(map + objectIndexHeaderSize + bloomBits / 8);
+}
 
-    std::ifstream branchIn(branchPath);
-    std::string parentHash;
-    std::getline(branchIn, parentHash);
-    branchIn.close();
+bool ObjectIdIndex::bloomTest(uint64_t id) const{
+    uint64_t h1 = id, h2 = mixId(id) | 1;
+    for(uint32_t i = 0; i < hashCount; ++i){
+        uint64_t bit = (h1 + i * h2) & (bloomBits - 1);
+        if(!(bloom()[bit >> 3] & (1u << (bit & 7)))) return false;
+    }
+    return true;
+}
 
-    time_t now = time(0);
-    std::string timestamp = ctime(&now);
-    std::string combined = message + timestamp;
-    std::string commitHash = computeHash(combined);
+void ObjectIdIndex::bloomSet(uint64_t id){
+    uint64_t h1 = id, h2 = mixId(id) | 1;
+    for(uint32_t i = 0; i < hashCount; ++i){
+        uint64_t bit = (h1 + i * h2) & (bloomBits - 1);
+        bloom()[bit >> 3] |= (1u << (bit & 7));
+    }
+}
 
-    //create commit file
-    fs::create_directory(baseDir + "/commits");
-    std::string commitPath = baseDir + "/commits/" + commitHash + ".txt";
+ObjectIdIndex::Lookup ObjectIdIndex::lookup(uint64_t id){
+    if(!open()) return Unknown;
+    if(!bloomTest(id)) return Absent;
+    if(std::binary_search(table(), table() + count, id)) return Present;
+    if(std::binary_search(logIds.begin(), logIds.end(), id)) return Present;
+    return Absent;
+}
 
-    std::ofstream commitFile(commitPath);
-    commitFile<< "message: "<<message<<"\n";
-    commitFile<<"timestamp: "<<timestamp;
-    commitFile<<"parent: "<<(parentHash == "null"? "null":parentHash)<<"\n";
-    commitFile<<"files:\n";
+//up to limit IDs in [low, high], in order, found by binary search in the table and the log
+std::vector<uint64_t> ObjectIdIndex::range(uint64_t low, uint64_t high, size_t limit){
+    std::vector<uint64_t> ids;
+    if(!open()) return ids;
+    for(const uint64_t* it = std::lower_bound(table(), table() + count, low);
+        it != table() + count && *it <= high && ids.size() < limit; ++it){
+        ids.push_back(*it);
+    }
+    for(auto it = std::lower_bound(logIds.begin(), logIds.end(), low);
+        it != logIds.end() && *it <= high && ids.size() < limit; ++it){
+        ids.push_back(*it);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
 
-    //Read staged file from index
-    std::ifstream indexIn(baseDir + "/index");
-    std::string filename;
-    while(std::getline(indexIn, filename)){
-        if (!fs::exists(filename)) {
-            std::cout << "Warning: File '" << filename << "' was staged but no longer exists. Skipping.\n";
-            continue;
+void ObjectIdIndex::insert(uint64_t id){
+    if(!open()) return;
+    if(lookup(id) == Present) return;
+    std::ofstream logOut(logPath, std::ios::binary | std::ios::app);
+    logOut.write(reinterpret_cast<const char*>(&id), sizeof(id));
+    logOut.close();
+    bloomSet(id);
+    logIds.insert(std::upper_bound(logIds.begin(), logIds.end(), id), id);
+}
+
+//the log is folded into the sorted table once it grows past an eighth of it
+bool ObjectIdIndex::needsCompaction(){
+    if(!open()) return true;
+    return logIds.size() > std::max<uint64_t>(1024, count / 8);
+}
+
+std::vector<uint64_t> ObjectIdIndex::allIds(){
+    std::vector<uint64_t> ids;
+    if(!open()) return ids;
+    ids.assign(table(), table() + count);
+    ids.insert(ids.end(), logIds.begin(), logIds.end());
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void ObjectIdIndex::rebuild(std::vector<uint64_t> ids){
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    close();
+
+    //about 10 bits per entry with headroom for the log, rounded to a power of two
+    uint64_t bits = 8192;
+    while(bits < (ids.size() + ids.size() / 8 + 1024) * 10) bits <<= 1;
+
+    std::string data(objectIndexHeaderSize + bits / 8 + ids.size() * 8, '\0');
+    uint32_t version = 1, k = 7;
+    uint64_t n = ids.size();
+    std::memcpy(&data[0], "MGIX", 4);
+    std::memcpy(&data[4], &version, 4);
+    std::memcpy(&data[8], &n, 8);
+    std::memcpy(&data[16], &bits, 8);
+    std::memcpy(&data[24], &k, 4);
+    unsigned char* bloomBytes = reinterpret_cast<unsigned char*>(&data[objectIndexHeaderSize]);
+    for(uint64_t id : ids){
+        uint64_t h1 = id, h2 = mixId(id) | 1;
+        for(uint32_t i = 0; i < k; ++i){
+            uint64_t bit = (h1 + i * h2) & (bits - 1);
+            bloomBytes[bit >> 3] |= (1u << (bit & 7));
         }
+    }
+    if(!ids.empty()){
+        std::memcpy(&data[objectIndexHeaderSize + bits / 8], ids.data(), ids.size() * 8);
+    }
 
-        std::ifstream fileIn(filename);
-        std::stringstream buffer;
-        buffer<< fileIn.rdbuf();
-        std::string content= buffer.str();
-        std::string hash = computeHash(content);
-        commitFile<<" "<<filename<<" -> "<< hash <<"\n";
-    }
-    indexIn.close();
-    commitFile.close();
-
-    //update branch pointer
-    std::ofstream branchOut(branchPath);
-    branchOut << commitHash;
-    branchOut.close();
-
-    //clear the index after commit
-    std::ofstream clearIndex(baseDir + "/index", std::ios::trunc);
-    if(clearIndex.is_open()){
-        clearIndex.close();
-        std::cout<<"Index cleared after commit.\n";
-    }else{
-        std::cout<<"warning: could not clear index.\n";
+    //publish by rename so readers keep a consistent mapping of the old file
+    std::error_code ec;
+    if(writeWholeFile(path + ".tmp", data)){
+        fs::rename(path + ".tmp", path, ec);
+        if(!ec) fs::remove(logPath, ec);
     }
 }
 
-void MiniGitRepo::log() {
-    // Step 1: Read HEAD to get current branch
-    std::ifstream headIn(headFile);
-    std::string headRef;
-    std::getline(headIn, headRef);  // e.g., "ref: refs/main"
-    headIn.close();
+/*
+ log-index layout (native endian):
+   char[4] "MGTI", u32 version, u64 count
+   count postings (u64 term, u64 commit) sorted by term, then commit
+ log-index.log holds postings appended since the last rebuild.
+*/
+const size_t termIndexHeaderSize = 16;
 
-    std::string branch = headRef.substr(5);  // remove "ref: "
-    std::string branchPath = baseDir + "/" + branch;
+static bool operator<(const Posting& a, const Posting& b){
+    return a.term != b.term ? a.term < b.term : a.commit < b.commit;
+}
 
-    // Step 2: Get latest commit hash
-    std::ifstream branchIn(branchPath);
-    std::string currentHash;
-    std::getline(branchIn, currentHash);
-    branchIn.close();
+static bool operator==(const Posting& a, const Posting& b){
+    return a.term == b.term && a.commit == b.commit;
+}
 
-    if (currentHash == "null" || currentHash.empty()) {
-        std::cout << "No commits yet.\n";
-        return;
+TermIndex::TermIndex(const std::string& indexPath)
+    : path(indexPath), logPath(indexPath + ".log"){}
+
+TermIndex::~TermIndex(){
+    close();
+}
+
+void TermIndex::close(){
+    if(map) ::munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    count = 0;
+    logPostings.clear();
+    opened = false;
+}
+
+bool TermIndex::open(){
+    if(opened) return true;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || (size_t)st.st_size < termIndexHeaderSize){
+        ::close(fd);
+        return false;
     }
-// Step 3: Follow the parent chain and print commits
-    while (currentHash != "null") {
-        std::string commitPath = baseDir + "/commits/" + currentHash + ".txt";
-        std::ifstream commitIn(commitPath);
-        if (!commitIn) {
-            std::cout << "Error: Commit file not found: " << commitPath << "\n";
-            break;
-        }
-        std::string line;
-        std::string message, timestamp, parent;
+    void* mem = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) return false;
 
-        while (std::getline(commitIn, line)) {
-            if (line.rfind("message:", 0) == 0)
-                message = line.substr(8);
-            else if (line.rfind("timestamp:", 0) == 0)
-                timestamp = line.substr(10);
-            else if (line.rfind("parent:", 0) == 0)
-                parent = line.substr(7);
-                parent.erase(0, parent.find_first_not_of(" \t\r\n"));
-                parent.erase(parent.find_last_not_of(" \t\r\n")+1);
-        }
+    map = static_cast<unsigned char*>(mem);
+    mapSize = st.st_size;
+    uint32_t version;
+    std::memcpy(&version, map + 4, 4);
+    std::memcpy(&count, map + 8, 8);
+    if(std::memcmp(map, "MGTI", 4) != 0 || version != 1 || termIndexHeaderSize + count * sizeof(Posting) != mapSize){
+        close();
+        return false;
+    }
+
+    std::ifstream logIn(logPath, std::ios::binary);
+    Posting posting;
+    while(logIn.read(reinterpret_cast<char*>(&posting), sizeof(posting))){
+        logPostings.push_back(posting);
+    }
+    std::sort(logPostings.begin(), logPostings.end());
+    opened = true;
+    return true;
+}
 
-        std::cout << "-------------------------------\n";
-        std::cout << "Commit Hash: " << currentHash << "\n";
-        std::cout << "Message:     " << message << "\n";
-        std::cout << "Timestamp:   " << timestamp;
-        std::cout << "-------------------------------\n";
+bool TermIndex::available(){
+    return open();
+}
+
+const Posting* TermIndex::table() const{
+    return reinterpret_cast<const Posting*>(map + termIndexHeaderSize);
+}
 
-        currentHash = parent;
+//commits containing term, sorted and without duplicates
+std::vector<uint64_t> TermIndex::lookup(uint64_t term){
+    std::vector<uint64_t> commits;
+    if(!open()) return commits;
+    auto byTerm = [](const Posting& p, uint64_t t){ return p.term < t; };
+    for(const Posting* p = std::lower_bound(table(), table() + count, term, byTerm);
+        p != table() + count && p->term == term; ++p){
+        commits.push_back(p->commit);
+    }
+    for(auto it = std::lower_bound(logPostings.begin(), logPostings.end(), term, byTerm);
+        it != logPostings.end() && it->term == term; ++it){
+        commits.push_back(it->commit);
     }
+    std::sort(commits.begin(), commits.end());
+    commits.erase(std::unique(commits.begin(), commits.end()), commits.end());
+    return commits;
 }
 
-void MiniGitRepo::branch(const std::string& branchName){
-    //Get current branch from HEAD
-    std::ifstream headIn(headFile);
-    std::string headRef;
-    std::getline(headIn,headRef);
-    headIn.close();
+//same policy as the object index: fold the log in once it outgrows an eighth of the table
+bool TermIndex::needsCompaction(){
+    if(!open()) return false;
+    return logPostings.size() > std::max<uint64_t>(4096, count / 8);
+}
 
-    std::string currentBranchPath= baseDir + "/" + headRef.substr(5);  //remove "ref: "
-    std::ifstream currentBranchIn(currentBranchPath);
-    std::string currentCommitHash;
-    std::getline(currentBranchIn, currentCommitHash);
-    currentBranchIn.close();
+std::vector<Posting> TermIndex::allPostings(){
+    std::vector<Posting> postings;
+    if(!open()) return postings;
+    postings.assign(table(), table() + count);
+    postings.insert(postings.end(), logPostings.begin(), logPostings.end());
+    return postings;
+}
 
-    std::string newBranchPath = refsDir + "/" + branchName;
+void TermIndex::rebuild(std::vector<Posting> postings){
+    std::sort(postings.begin(), postings.end());
+    postings.erase(std::unique(postings.begin(), postings.end()), postings.end());
+    close();
 
-    //check if branch already exists
-    if(fs::exists(newBranchPath)){
-        std::cout<<" Error: Branch '"<< branchName<< "'already exists.\n";
-        return;
+    std::string data(termIndexHeaderSize + postings.size() * sizeof(Posting), '\0');
+    uint32_t version = 1;
+    uint64_t n = postings.size();
+    std::memcpy(&data[0], "MGTI", 4);
+    std::memcpy(&data[4], &version, 4);
+    std::memcpy(&data[8], &n, 8);
+    if(!postings.empty()){
+        std::memcpy(&data[termIndexHeaderSize], postings.data(), postings.size() * sizeof(Posting));
+    }
+    std::error_code ec;
+    if(writeWholeFile(path + ".tmp", data)){
+        fs::rename(path + ".tmp", path, ec);
+        if(!ec) fs::remove(logPath, ec);
     }
+}
 
-    //create the new branch file and point it to current commit
-    std::ofstream newBranchOut(newBranchPath);
-    newBranchOut<< currentCommitHash;
-    newBranchOut.close();
+void MiniGitRepo::beginBatch(){
+    ++batchDepth;
+}
 
-    std::cout<<"Branch '"<<branchName<<"'created at commit"<< currentCommitHash<<"\n";
+Error MiniGitRepo::endBatch(){
+    if(batchDepth > 0) --batchDepth;
+    return commitJournal();
 }
-void MiniGitRepo::checkout(const std::string& branchName){
-    std::string newBranchPath = refsDir + "/" + branchName;
 
-    if(!fs::exists(newBranchPath)){
-        std::cout<<"Error: Branch '"<<branchName<<"' does not exist.\n";
-        return;
-    }
+void MiniGitRepo::journalWrite(const std::string& path, std::string content){
+    if(journalFailure.code != ErrorCode::None) return;
+    journalBytes += content.size();
+    journalPaths.insert(path);
+    journalEntries.push_back({path, std::move(content), false});
 
-    //update HEAD to point to the new branch
-    std::ofstream headOut(headFile);
-    headOut<< "ref: refs/"<< branchName<<"\n";
-    headOut.close();
+    //objects are content addressed, so publishing them early is safe and bounds memory for huge adds
+    const size_t maxPendingBytes = 64 << 20;
+    if(journalBytes > maxPendingBytes){
+        flushJournal(false);
+    }
+}
 
-    std::cout<<"Switched to branch '"<< branchName<<"'\n";
+void MiniGitRepo::journalRef(const std::string& refPath, const std::string& value){
+    if(journalFailure.code != ErrorCode::None) return;
+    //a later ref update in the same group replaces the earlier one
+    for(auto& entry : journalEntries){
+        if(entry.isRef && entry.path == refPath){
+            entry.content = value;
+            return;
+        }
+    }
+    journalPaths.insert(refPath);
+    journalEntries.push_back({refPath, value, true});
+}
 
-    //Read the latest commit hash from the branch
-    std::ifstream branchIn(newBranchPath);
-    std::string latestCommitHash;
-    std::getline(branchIn, latestCommitHash);
-    branchIn.close();
+//side records (changed-path filters, log postings) are appended in the same group as
+//the commit they describe, so a crash can never leave a record without its commit
+void MiniGitRepo::journalAppend(const std::string& path, const std::string& bytes){
+    if(journalFailure.code != ErrorCode::None || bytes.empty()) return;
+    journalBytes += bytes.size();
+    for(auto& entry : journalEntries){
+        if(entry.isAppend && entry.path == path){
+            entry.content += bytes;
+            return;
+        }
+    }
+    journalPaths.insert(path);
+    journalEntries.push_back({path, bytes, false, true});
+}
 
-    if(latestCommitHash == "null"|| latestCommitHash.empty()){
-        std::cout<<"No commits on this branch yet.\n";
-        return;
+//publish an append: cut the file back to where it ended when the journal was written,
+//then add the bytes, so replaying it after a crash never duplicates a record
+static bool appendAt(const std::string& path, uint64_t offset, const std::string& bytes){
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if(fd < 0) return false;
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0;
+    if(ok && static_cast<uint64_t>(st.st_size) > offset) ok = ::ftruncate(fd, offset) == 0;
+    if(ok) ok = ::lseek(fd, 0, SEEK_END) >= 0;
+    for(size_t done = 0; ok && done < bytes.size();){
+        ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if(n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if(ok) done += n;
     }
+    ::close(fd);
+    return ok;
+}
 
-    //open the commit file and parse file mappings
-    std::string commitFilePath = baseDir + "/commits/" + latestCommitHash + ".txt";
-    if(!fs::exists(commitFilePath)){
-        std::cout<<"No commits yet on branch'"<<branchName<<"'\n";
-        return;
+//current size of a file, 0 when it does not exist yet
+static uint64_t fileSizeOr0(const std::string& path){
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+bool MiniGitRepo::journalHas(const std::string& path) const{
+    return journalPaths.count(path) > 0;
+}
+
+//read a ref, seeing updates that are still waiting in the journal
+std::string MiniGitRepo::readRef(const std::string& refPath) const{
+    for(auto it = journalEntries.rbegin(); it != journalEntries.rend(); ++it){
+        if(it->isRef && it->path == refPath) return it->content.substr(0, it->content.find('\n'));
     }
-    std::ifstream commitFile(commitFilePath);
+    std::ifstream in(refPath);
+    std::string value;
+    std::getline(in, value);
+    return value;
+}
 
-    std::string line;
-    bool fileSection = false;
+//flush at the end of an operation unless a batch is collecting several of them;
+//returns the error that dropped the group, which ends with the group
+Error MiniGitRepo::commitJournal(){
+    if(batchDepth > 0) return journalFailure;
+    flushJournal();
+    Error failure = journalFailure;
+    journalFailure = Error();
+    return failure;
+}
 
-    while(std::getline(commitFile,line)){
-        if(line== "files:"){
-            fileSection= true;
-            continue;
-        }
-        if(fileSection && !line.empty()){
-            size_t arrow = line.find("->");
-            if(arrow == std::string::npos) continue;
+//throw away every queued write, including temp files a flush already made
+void MiniGitRepo::discardJournal(){
+    std::error_code ec;
+    for(const auto& entry : journalEntries) fs::remove(entry.path + ".tmp", ec);
+    fs::remove(journalFile, ec);
+    journalEntries.clear();
+    journalBytes = 0;
+    journalPaths.clear();
+}
 
-            std::string filename= line.substr(0, arrow-1);
-            std::string hash = line.substr(arrow+3);
+/*
+ Group flush:
+   1. every pending write goes to "<path>.tmp" without syncing
+   2. the journal lists each target with a checksum and ends with "end"
+   3. one syncfs makes the temp files and the journal durable together
+   4. temp files are renamed into place, objects first and refs last,
+      so a ref is never published before the objects it points to;
+      appends in between are applied at the offset the journal recorded
+ A crash before the journal is complete leaves only temp files behind;
+ a crash after it is replayed by recoverJournal(). A group that cannot be made
+ durable is dropped whole, held refs included, so no ref can ever be published
+ for objects that were thrown away.
+*/
+Error MiniGitRepo::flushJournal(bool includeRefs){
+    if(journalEntries.empty()) return journalFailure;
 
-            //trim spaces
-            filename.erase(0, filename.find_first_not_of(" \t\r\n"));
-            filename.erase(filename.find_last_not_of(" \t\r\n")+1);
-            hash.erase(0, hash.find_first_not_of(" \t\r\n"));
-            hash.erase(hash.find_last_not_of(" \t\r\n") + 1);
+    auto firstRef = std::stable_partition(journalEntries.begin(), journalEntries.end(),
+        [](const JournalEntry& entry){ return !entry.isRef; });
 
-            std::ifstream blob(objectsDir + "/" + hash );
-            if(!blob.is_open()){
-                std::cout<<"Error: blob not found for file: "<< filename<<"\n";
-                continue;
-            }
-            std::ofstream outFile(filename);
-            outFile << blob.rdbuf();
-            blob.close();
-            outFile.close();
+    //an objects-only flush keeps the refs queued for the end of the group
+    std::vector<JournalEntry> heldRefs;
+    if(!includeRefs){
+        heldRefs.assign(std::make_move_iterator(firstRef), std::make_move_iterator(journalEntries.end()));
+        journalEntries.erase(firstRef, journalEntries.end());
+        if(journalEntries.empty()){
+            journalEntries = std::move(heldRefs);
+            return journalFailure;
+        }
+    }
+
+    //this also runs from the destructor, so nothing below may throw
+    std::error_code ec;
+    auto dropGroup = [&](const std::string& message){
+        discardJournal();
+        journalFailure = Error{ErrorCode::WriteFailed, message};
+        return journalFailure;
+    };
+
+    std::stringstream journal;
+    journal<<"minigit-journal 1\n";
+    std::vector<uint64_t> offsets;
+    for(const auto& entry : journalEntries){
+        fs::path parent = fs::path(entry.path).parent_path();
+        if(!parent.empty()) fs::create_directories(parent, ec);
+        if(!writeWholeFile(entry.path + ".tmp", entry.content)){
+            return dropGroup("could not write " + entry.path + ": " + std::strerror(errno));
+        }
+        offsets.push_back(entry.isAppend ? fileSizeOr0(entry.path) : 0);
+        if(entry.isAppend){
+            journal<<"app\t"<<computeHash(entry.content)<<"\t"<<offsets.back()<<"\t"<<entry.path<<"\n";
+        }else{
+            journal<<(entry.isRef ? "ref" : "obj")<<"\t"<<computeHash(entry.content)<<"\t"<<entry.path<<"\n";
+        }
+    }
+    journal<<"end\n";
+    if(!writeWholeFile(journalFile, journal.str())){
+        return dropGroup("could not write the journal " + journalFile + ": " + std::strerror(errno));
+    }
+    if(!syncFilesystem(baseDir)){
+        return dropGroup(std::string("could not sync the journal: ") + std::strerror(errno));
+    }
 
-            std::cout<<"Restored: "<<filename<<'\n';
+    //from here on the group is durable: a publish that fails is finished by recoverJournal()
+    for(size_t i = 0; i < journalEntries.size(); ++i){
+        const JournalEntry& entry = journalEntries[i];
+        if(entry.isAppend){
+            if(appendAt(entry.path, offsets[i], entry.content)) fs::remove(entry.path + ".tmp", ec);
+            else ec = std::error_code(errno, std::generic_category());
+        }else{
+            fs::rename(entry.path + ".tmp", entry.path, ec);
+        }
+        if(ec){
+            std::string message = "could not publish " + entry.path + ": " + ec.message() +
+                                  "; the journal will finish it on the next write";
+            journalEntries.clear();
+            journalBytes = 0;
+            journalPaths.clear();
+            journalFailure = Error{ErrorCode::WriteFailed, message};
+            return journalFailure;
         }
     }
+    fs::remove(journalFile, ec);
 
-    commitFile.close();
+    //keep the object-ID and commit-ID indexes current with everything that was just published
+    bool wrotePostings = false;
+    std::vector<std::string> published;
+    for(const auto& entry : journalEntries){
+        if(entry.isAppend) wrotePostings = wrotePostings || entry.path == logIndexFile + ".log";
+        if(!entry.isRef && !entry.isAppend) published.push_back(entry.path);
+    }
+    indexPublished(published);
+    journalEntries = std::move(heldRefs);
+    journalBytes = 0;
+    journalPaths.clear();
+    for(const auto& held : journalEntries) journalPaths.insert(held.path);
+    if(wrotePostings){
+        logIndex.close();
+        if(logIndex.needsCompaction()) logIndex.rebuild(logIndex.allPostings());
+    }
+    return journalFailure;
 }
 
-std::string findLCA(const std::string& commit1, const std::string& commit2){
-    std::set<std::string> ancestors;
+void MiniGitRepo::recoverJournal(){
+    std::ifstream in(journalFile);
+    std::string line;
+    std::vector<std::string> published;
+    struct Replay{
+        std::string path;
+        std::string checksum;
+        bool isAppend;
+        uint64_t offset;
+    };
+    std::vector<Replay> entries;
+    bool complete = false;
 
-    //Traverse commit1 ancestors
-    std::string current = commit1;
-    while( current != "null" && !current.empty()){
-        ancestors.insert(current);
-        std::ifstream in(".minigit/commits/" + current + ".txt");
-        std::string line;
-        while(std::getline(in, line)){
-            if(line.rfind("parent:", 0) == 0){
-                current = line.substr(7);
-                current.erase(0, current.find_first_not_of(" \t\r\n"));
-                current.erase(current.find_last_not_of(" \t\r\n") + 1);
-                break;
-            }
+    std::getline(in, line);
+    while(std::getline(in, line)){
+        if(line == "end"){
+            complete = true;
+            break;
         }
-        in.close();
+        size_t tab1 = line.find('\t');
+        size_t tab2 = line.find('\t', tab1 + 1);
+        if(tab1 == std::string::npos || tab2 == std::string::npos) break;
+        Replay entry{line.substr(tab2 + 1), line.substr(tab1 + 1, tab2 - tab1 - 1), line.compare(0, tab1, "app") == 0, 0};
+        if(entry.isAppend){
+            //app <checksum> <offset> <path>
+            size_t tab3 = line.find('\t', tab2 + 1);
+            if(tab3 == std::string::npos) break;
+            entry.offset = std::strtoull(line.c_str() + tab2 + 1, nullptr, 10);
+            entry.path = line.substr(tab3 + 1);
+        }
+        entries.push_back(std::move(entry));
     }
-    //Traverse commit2 ancestors to find first common
-    current = commit2;
-    while(current != "null" && !current.empty()){
-        if(ancestors.count(current)) return current;
-        std::ifstream in(".minigit/commits/" + current + ".txt");
-        std::string line;
-        while(std::getline(in, line)){
-            if(line.rfind("parent:", 0)== 0){
-                current= line.substr(7);
-                current.erase(0, current.find_first_not_of(" \t\r\n"));
-                current.erase(current.find_last_not_of("\t\r\n") + 1);
-                break;
+    in.close();
+
+    //only publish when every temp file still matches its checksum, refs come last
+    bool intact = complete;
+    for(const auto& entry : entries){
+        std::string tmpPath = entry.path + ".tmp";
+        if(!fs::exists(tmpPath)) continue; //already published before the crash
+        std::ifstream tmpIn(tmpPath);
+        std::stringstream buffer;
+        buffer<< tmpIn.rdbuf();
+        if(computeHash(buffer.str()) != entry.checksum) intact = false;
+    }
+
+    for(const auto& entry : entries){
+        std::string tmpPath = entry.path + ".tmp";
+        if(intact && !entry.isAppend) published.push_back(entry.path);
+        if(!fs::exists(tmpPath)) continue;
+        if(intact && entry.isAppend){
+            std::ifstream tmpIn(tmpPath, std::ios::binary);
+            std::stringstream buffer;
+            buffer<< tmpIn.rdbuf();
+            if(appendAt(entry.path, entry.offset, buffer.str())) fs::remove(tmpPath);
+        }else if(intact){
+            fs::rename(tmpPath, entry.path);
+        }else{
+            fs::remove(tmpPath);
+        }
+    }
+    fs::remove(journalFile);
+    //entries renamed before the crash may have missed the index too, so all of them go in again
+    if(intact) indexPublished(published);
+
+    if(!intact){
+        recovery = Error{ErrorCode::WriteFailed, "discarded an interrupted write from the journal."};
+    }
+}
+
+//index what a flush or a replayed journal just put in place; an ID already present is skipped
+void MiniGitRepo::indexPublished(const std::vector<std::string>& published){
+    bool wroteObjects = false, wroteCommits = false;
+    const std::string commitsDir = baseDir + "/commits/";
+    for(const auto& path : published){
+        uint64_t id;
+        fs::path file(path);
+        if(path.compare(0, objectsDir.size(), objectsDir) == 0){
+            if(parseObjectId(file.filename().string(), id)){
+                objectIndex.insert(id);
+                wroteObjects = true;
+            }
+        }else if(path.compare(0, commitsDir.size(), commitsDir) == 0 && file.extension() == ".txt"){
+            if(parseObjectId(file.stem().string(), id)){
+                commitIndex.insert(id);
+                wroteCommits = true;
             }
         }
-        in.close();
     }
+    if(wroteObjects && objectIndex.needsCompaction()){
+        rebuildObjectIndex();
+    }
+    if(wroteCommits && commitIndex.needsCompaction()){
+        rebuildCommitIndex();
+    }
+}
 
-    return "null";  //No common ancestor found
+//objects are sharded by the first two hex digits: objects/ab/abcdef...
+std::string MiniGitRepo::objectPath(const std::string& hash) const{
+    if(hash.size() < 2) return objectsDir + "/" + hash;
+    return objectsDir + "/" + hash.substr(0, 2) + "/" + hash;
 }
 
-void MiniGitRepo::merge(const std::string& otherBranchName){
-    //Load current branch from HEAD
-        std::ifstream headIn(headFile);
-        std::string headRef;
-        std::getline(headIn, headRef);
-        headIn.close();
+//locate a stored object, falling back to the legacy flat layout; "" when missing
+std::string MiniGitRepo::findObject(const std::string& hash) const{
+    if(hash.empty()) return "";
+    std::string sharded = objectPath(hash);
+    if(fs::exists(sharded)) return sharded;
+    std::string flat = objectsDir + "/" + hash;
+    if(fs::is_regular_file(flat)) return flat;
+    return "";
+}
 
-    std::string currentBranch = headRef.substr(5); //remove "ref: "
-    std::string currentBranchPath = baseDir + "/"  + currentBranch;
-    std::string otherBranchPath = refsDir + "/"  + otherBranchName;
+//answer "do we already have this object" from the index, touching the filesystem only on a hit
+bool MiniGitRepo::hasObject(const std::string& hash){
+    uint64_t id;
+    if(!parseObjectId(hash, id)) return !findObject(hash).empty();
 
-    //check if other branch exisits
-    if(!fs::exists(otherBranchPath)){
-        std::cout<<"Error: Branch '"<< otherBranchName<<"' does not exist.\n";
-        return;
+    ObjectIdIndex::Lookup found = objectIndex.lookup(id);
+    if(found == ObjectIdIndex::Unknown && fs::exists(objectsDir)){
+        rebuildObjectIndex();
+        found = objectIndex.lookup(id);
     }
+    if(found == ObjectIdIndex::Absent) return false;
+    return !findObject(hash).empty();
+}
 
-    std::string currentHash, otherHash;
-    std::ifstream curIn(currentBranchPath);
-    std::ifstream othIn(otherBranchPath);
-    std::getline(curIn, currentHash);
-    std::getline(othIn, otherHash);
-    curIn.close();
-    othIn.close();
+//rescan both object layouts and rewrite objects.idx from scratch
+void MiniGitRepo::rebuildObjectIndex(){
+    std::vector<uint64_t> ids;
+    std::error_code ec;
+    for(fs::recursive_directory_iterator it(objectsDir, ec), end; !ec && it != end; it.increment(ec)){
+        uint64_t id;
+        if(it->is_regular_file(ec) && parseObjectId(it->path().filename().string(), id)) ids.push_back(id);
+    }
+    objectIndex.rebuild(ids);
+}
 
-    if(otherHash == "null" || otherHash.empty()){
-        std::cout<<"other branch has no commits.\n";
-        return;
+//list the commits directory and rewrite commits.idx from scratch
+void MiniGitRepo::rebuildCommitIndex(){
+    std::vector<uint64_t> ids;
+    std::error_code ec;
+    for(const auto& entry : fs::directory_iterator(baseDir + "/commits", ec)){
+        uint64_t id;
+        if(entry.path().extension() == ".txt" && parseObjectId(entry.path().stem().string(), id)) ids.push_back(id);
     }
-    std::string lca = findLCA(currentHash, otherHash);
-    std::cout<<"LCA: "<< lca<<"\n";
+    commitIndex.rebuild(ids);
+}
 
-    //Helper lambda to parse commit files
-    auto parseCommit =[](const std::string& hash) -> std::map<std::string, std::string>{
-        std::map<std::string, std::string> files;
-        if(hash == "null" || hash.empty()) return files;
+/*
+ Commits whose hash starts with prefix, at most limit of them. Hashes are printed
+ without leading zeros, so a prefix of p digits is looked up once for every hash
+ length from p to 16: [prefix, prefix + 1) shifted to that length, clamped to the
+ IDs that print with exactly that many digits.
+*/
+std::vector<std::string> MiniGitRepo::commitsWithPrefix(const std::string& prefix, size_t limit){
+    std::vector<std::string> found;
+    uint64_t value;
+    if(prefix.empty() || prefix.size() > 16 || prefix[0] == '0' || !parseObjectId(prefix, value)) return found;
+    //a repository that predates commits.idx builds it once; readers never rewrite the
+    //index or its log without the lock, since a writer may be appending to them
+    if(!fs::exists(commitIndexFile) && lockForWrite().code == ErrorCode::None && !fs::exists(commitIndexFile)){
+        rebuildCommitIndex();
+    }
 
-        std::ifstream file(".minigit/commits/" + hash + ".txt");
-        std::string line;
-        bool section = false;
-        while(std::getline(file, line)){
-            if(line=="files:"){
-                section = true;
-                continue;
-            }
-            if(section && !line.empty()){
-                size_t arrow = line.find("->");
-                std::string name= line.substr(0, arrow-1);
-                std::string blob = line.substr(arrow+3);
-                name.erase(0,name.find_first_not_of(" \t\r\n"));
-                name.erase(name.find_last_not_of(" \t\r\n") + 1);
-                blob.erase(0,blob.find_first_not_of(" \t\r\n"));
-                blob.erase(blob.find_last_not_of(" \t\r\n")+1);
-                files[name]=blob;
-            }
+    for(size_t digits = prefix.size(); digits <= 16 && found.size() < limit; ++digits){
+        unsigned shift = 4 * (digits - prefix.size());
+        uint64_t low = value << shift;
+        uint64_t high = shift == 0 ? value : low | ((uint64_t(1) << shift) - 1);
+        for(uint64_t id : commitIndex.range(low, high, limit - found.size())){
+            std::string hash = formatObjectId(id);
+            if(hash.size() == digits) found.push_back(hash);
         }
-        return files;
-    };
+    }
+    return found;
+}
+/*
+ Content-defined chunking (FastCDC style) for large files. The gear hash at position i
+ covers the 64 bytes ending at i: h(i) = sum G[d[i-j]] << j. Because it only depends
+ on that window it can be computed for many positions at once, so hashes are produced
+ a block at a time by a lane-parallel kernel and the cut is picked with FastCDC's
+ normalized masks: a stricter mask before the normal size, a looser one after it.
+ A chunked blob is a chunk list: "minigit-chunks 1" then "<chunk hash> <size>" lines.
+*/
+const size_t chunkedThreshold = 1 << 20;
+const size_t chunkMinSize = 16 << 10;
+const size_t chunkNormalSize = 64 << 10;
+const size_t chunkMaxSize = 256 << 10;
+const uint64_t chunkMaskStrict = ~0ULL << (64 - 18);
+const uint64_t chunkMaskLoose = ~0ULL << (64 - 14);
+const std::string chunkListHeader = "minigit-chunks 1\n";
 
-    std::map<std::string, std::string> lcaFiles= parseCommit(lca);
-    std::map<std::string, std::string> curFiles = parseCommit(currentHash);
-    std::map<std::string, std::string> othFiles = parseCommit(otherHash);
+static const std::array<uint64_t, 256>& gearTable(){
+    static const std::array<uint64_t, 256> table = [](){
+        std::array<uint64_t, 256> t{};
+        for(size_t i = 0; i < t.size(); ++i) t[i] = mixId(i * 0x2545f4914f6cdd1dULL);
+        return t;
+    }();
+    return table;
+}
+
+//gear hashes for positions [from, from + count); needs 63 readable bytes before from
+static void gearHashes(const unsigned char* data, size_t from, size_t count, uint64_t* out){
+    const uint64_t* gear = gearTable().data();
+    const size_t lanes = 4;
+    size_t per = count / lanes;
 
-    std::map<std::string, std::string> mergedFiles = curFiles;
+#ifdef __AVX2__
+    if(per > 0){
+        __m256i h = _mm256_setzero_si256();
+        for(size_t j = 0; j < 63 + per; ++j){
+            //byte j of the window feeding each lane, lane k starts at from + k * per - 63
+            const unsigned char* base = data + from - 63 + j;
+            __m128i idx = _mm_set_epi32(base[3 * per], base[2 * per], base[per], base[0]);
+            h = _mm256_add_epi64(_mm256_slli_epi64(h, 1),
+                                 _mm256_i32gather_epi64(reinterpret_cast<const long long*>(gear), idx, 8));
+            if(j >= 63){
+                alignas(32) uint64_t lane[lanes];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lane), h);
+                for(size_t k = 0; k < lanes; ++k) out[k * per + j - 63] = lane[k];
+            }
+        }
+    }
+#else
+    if(per > 0){
+        uint64_t h[lanes] = {0, 0, 0, 0};
+        for(size_t j = 0; j < 63 + per; ++j){
+            const unsigned char* base = data + from - 63 + j;
+            for(size_t k = 0; k < lanes; ++k){
+                h[k] = (h[k] << 1) + gear[base[k * per]];
+            }
+            if(j >= 63){
+                for(size_t k = 0; k < lanes; ++k) out[k * per + j - 63] = h[k];
+            }
+        }
+    }
+#endif
 
-    for(const auto& entry : othFiles){
-        std::string file= entry.first;
-        std::string othBlob = entry.second;
-        std::string lcaBlob = lcaFiles.count(file) ? lcaFiles[file]:"";
-        std::string curBlob = curFiles.count(file) ? curFiles[file]:"";
+    //tail that doesn't divide evenly between the lanes
+    uint64_t h = 0;
+    size_t tail = per * lanes;
+    for(size_t i = from + tail - 63; i < from + count; ++i){
+        h = (h << 1) + gear[data[i]];
+        if(i >= from + tail) out[i - from] = h;
+    }
+}
 
-        if(curFiles.count(file)&& curBlob != othBlob && lcaBlob != curBlob && lcaBlob != othBlob){
-            std::cout<< "CONFLICT: both modifies"<<file<<"\n";
-            continue; //leave current branch`s version
+//length of the next chunk of data[0, len); len < chunkMaxSize only at end of file
+static size_t findChunkCut(const unsigned char* data, size_t len){
+    if(len <= chunkMinSize) return len;
+    size_t end = std::min(len, chunkMaxSize);
+    const size_t block = 4096;
+    std::vector<uint64_t> hashes(block);
+    for(size_t pos = chunkMinSize; pos < end; pos += block){
+        size_t count = std::min(block, end - pos);
+        gearHashes(data, pos, count, hashes.data());
+        for(size_t i = 0; i < count; ++i){
+            uint64_t mask = pos + i < chunkNormalSize ? chunkMaskStrict : chunkMaskLoose;
+            if((hashes[i] & mask) == 0) return pos + i + 1;
         }
-        //If file does not exist in current, task from other
-        if(!curFiles.count(file)){
-            mergedFiles[file] = othBlob;
+    }
+    return end;
+}
+
+//stream a file through the chunker, handing each chunk to emit without reading the whole file
+template<typename Emit>
+static bool chunkFile(const std::string& filename, Emit emit){
+    std::ifstream in(filename, std::ios::binary);
+    if(!in) return false;
+    const size_t readSize = 4 << 20;
+    std::string buffer;
+    size_t offset = 0;
+    bool eof = false;
+    while(true){
+        if(!eof && buffer.size() - offset < chunkMaxSize){
+            buffer.erase(0, offset);
+            offset = 0;
+            size_t have = buffer.size();
+            buffer.resize(have + readSize);
+            in.read(&buffer[have], readSize);
+            buffer.resize(have + in.gcount());
+            if(in.gcount() < std::streamsize(readSize)) eof = true;
         }
+        size_t left = buffer.size() - offset;
+        if(left == 0) break;
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer.data() + offset);
+        size_t cut = findChunkCut(data, left);
+        emit(buffer.data() + offset, cut);
+        offset += cut;
     }
-    //create a new merged commit
-    time_t now= time(0);
-    std::string timestamp= ctime(&now);
-    std::string combined ="Merged with" + otherBranchName + timestamp;
-    std::string newHash = computeHash(combined);
+    return true;
+}
 
-    std::ofstream out(baseDir + "/commits/" + newHash + ".txt");
-    out<<"message: Merge with "<< otherBranchName<<"\n";
-    out<<"timestamp: "<<timestamp;
-    out<<"parent: "<<currentHash<<"\n";
-    out<<"files:\n";
-    for(auto& [name, blob]: mergedFiles){
-        out<<" "<< name<<" -> "<< blob <<"\n";
+//blob id of a working file: content hash, or the hash of its chunk list for large files
+static std::string hashWorkingFile(const std::string& filename){
+    std::error_code ec;
+    if(fs::file_size(filename, ec) >= chunkedThreshold && !ec){
+        std::string list = chunkListHeader;
+        chunkFile(filename, [&](const char* data, size_t len){
+            list += computeHash(std::string(data, len)) + " " + std::to_string(len) + "\n";
+        });
+        return computeHash(list);
     }
-    out.close();
+    std::ifstream fileIn(filename);
+    std::stringstream buffer;
+    buffer<< fileIn.rdbuf();
+    return computeHash(buffer.str());
+}
 
-    //update HEAD
-    std::ofstream updateHead(baseDir + "/" + currentBranch);
-    updateHead<< newHash;
-    updateHead.close();
+//store the new chunks of a large file and return its chunk list
+std::string MiniGitRepo::storeChunkedFile(const std::string& filename, AddResult& result){
+    std::string list = chunkListHeader;
+    size_t chunks = 0, stored = 0;
+    chunkFile(filename, [&](const char* data, size_t len){
+        std::string chunk(data, len);
+        std::string hash = computeHash(chunk);
+        std::string path = objectPath(hash);
+        if(!journalHas(path) && !hasObject(hash)){
+            journalWrite(path, chunk);
+            ++stored;
+        }
+        ++chunks;
+        list += hash + " " + std::to_string(len) + "\n";
+    });
+    result.chunks = chunks;
+    result.newChunks = stored;
+    return list;
+}
 
-    std::cout<< "Merge complete. New commit: "<<newHash<<"\n";
+static bool isChunkList(const std::string& content){
+    return content.compare(0, chunkListHeader.size(), chunkListHeader) == 0;
 }
-void MiniGitRepo::diff(const std::string& commit1, const std::string& commit2) {
-    std::string path1=baseDir + "/commits/" + commit1 + ".txt";
-    std::string path2=baseDir + "/commits/" + commit2 + ".txt";
 
-    if (!fs::exists(path1) || !fs::exists(path2)) {
-        std::cout <<"One or both commits not found.\n";
-        return;
+//a blob is binary when its first 64 KiB hold a NUL byte; compared 32 bytes at a time with AVX2
+static bool looksBinary(std::string_view data){
+    const size_t limit = std::min<size_t>(data.size(), 64 * 1024);
+    const char* p = data.data();
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256();
+    for(; i + 32 <= limit; i += 32){
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero))) return true;
     }
+#endif
+    return std::memchr(p + i, 0, limit - i) != nullptr;
+}
 
-    auto parseFiles= [](const std::string& commitPath) -> std::map<std::string, std::string> {
-        std::ifstream file(commitPath);
-        std::map<std::string, std::string> result;
-        std::string line;
-        bool readingFiles=false;
+//full content of a blob, reassembling chunked blobs
+std::string MiniGitRepo::readBlob(const std::string& hash) const{
+    std::string path = findObject(hash);
+    if(path.empty()) return "";
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer<< in.rdbuf();
+    std::string content = buffer.str();
+    if(!isChunkList(content)) return content;
 
-        while(std::getline(file, line)) {
-            if ( line=="files:") {
-                readingFiles=true;
-                continue;
-            }
-            if (readingFiles && !line.empty()) {
-                size_t arrow = line.find("->");
-                if (arrow != std::string::npos) {
-                    std::string filename= line.substr(0,arrow- 1);
-                    std::string blob = line.substr(arrow + 3);
-                    filename.erase(0,filename.find_first_not_of(" \t\r\n"));
-                    filename.erase(filename.find_last_not_of(" \t\r\n") + 1);
-                    blob.erase(0,blob.find_first_not_of(" \t\r\n"));
-                    blob.erase(blob.find_last_not_of(" \t\r\n") + 1);
-                    result[filename]=blob;
-                }
-            }
-        }
-        return result;
-    };
+    std::stringstream list(content.substr(chunkListHeader.size()));
+    std::string chunkHash, assembled;
+    size_t size;
+    while(list>> chunkHash>> size){
+        std::ifstream chunk(findObject(chunkHash), std::ios::binary);
+        std::stringstream part;
+        part<< chunk.rdbuf();
+        assembled += part.str();
+    }
+    return assembled;
+}
 
-    auto files1= parseFiles(path1);
-    auto files2= parseFiles(path2);
+//size of a blob without loading it: a chunked blob sums its chunk list, a whole one is
+//its file size. binary is judged from the first 64 KiB, the window looksBinary() reads
+size_t MiniGitRepo::blobSize(const std::string& hash, bool& binary) const{
+    const size_t window = 64 * 1024;
+    binary = false;
+    std::string path = findObject(hash);
+    if(path.empty()) return 0;
+    std::ifstream in(path, std::ios::binary);
+    std::string head(window, '\0');
+    in.read(&head[0], head.size());
+    head.resize(in.gcount());
+    if(!isChunkList(head)){
+        binary = looksBinary(head);
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        return ec ? head.size() : size;
+    }
 
-    std::set<std::string> allFiles;
-    for (const auto& f: files1) allFiles.insert(f.first);
-    for (const auto& f: files2) allFiles.insert(f.first);
+    in.clear();
+    in.seekg(chunkListHeader.size());
+    std::string chunkHash, prefix;
+    size_t size, total = 0;
+    while(in>> chunkHash>> size){
+        total += size;
+        if(prefix.size() >= window) continue;
+        std::ifstream chunk(findObject(chunkHash), std::ios::binary);
+        std::string part(window - prefix.size(), '\0');
+        chunk.read(&part[0], part.size());
+        prefix.append(part, 0, chunk.gcount());
+    }
+    binary = looksBinary(prefix);
+    return total;
+}
 
-    for (const auto& file: allFiles) {
-        std::cout << "===File:" <<file << "===\n";
+//write a blob into the working tree, streaming chunk by chunk for chunked blobs
+bool MiniGitRepo::restoreBlob(const std::string& hash, const std::string& filename) const{
+    std::string path = findObject(hash);
+    if(path.empty()) return false;
+    std::ifstream blob(path, std::ios::binary);
+    if(!blob.is_open()) return false;
 
-        std::string blob1= files1.count(file) ? files1[file]:"";
-        std::string blob2= files2.count(file) ? files2[file]:"";
+    fs::path parent = fs::path(filename).parent_path();
+    if(!parent.empty()) fs::create_directories(parent);
 
-        std::string file1=objectsDir + "/" + blob1;
-        std::string file2=objectsDir + "/" + blob2;
+    std::string header(chunkListHeader.size(), '\0');
+    blob.read(&header[0], header.size());
+    header.resize(blob.gcount());
 
-        std::ifstream f1(file1), f2(file2);
-        std::string line1, line2;
-        int lineNum=1;
+    std::ofstream outFile(filename, std::ios::binary);
+    if(header != chunkListHeader){
+        outFile<< header<< blob.rdbuf();
+        return true;
+    }
 
-        while (getline(f1,line1) || getline(f2,line2)) {
-            bool l1= !f1.eof(), l2= !f2.eof();
+    std::string chunkHash;
+    size_t size;
+    while(blob>> chunkHash>> size){
+        std::ifstream chunk(findObject(chunkHash), std::ios::binary);
+        if(!chunk.is_open()) return false;
+        outFile<< chunk.rdbuf();
+    }
+    return true;
+}
 
-            if (line1 != line2) {
-                std::cout<< "Line "<< lineNum << ":\n";
-                if (l1) std::cout<< " -" << line1 <<"\n";
-                if (l2) std::cout<< " +" << line2 <<"\n";
-            }
-            line1.clear(); line2.clear();
-            ++lineNum;
-        }
+static std::map<std::string, StatEntry> walkWorkingTree(const std::string& skipDir, const std::string& root = ".",
+                                                  PathMatcher* ignore = nullptr);
+static void saveStatCache(const std::string& file, const std::map<std::string, StatEntry>& entries, const std::string& token);
 
-        std::cout<< "\n";
+/*
+ Fixed-capacity queue between two pipeline stages. push blocks while the queue is
+ full, which is what keeps fast readers from running ahead of the hashers and
+ writer; pop blocks while it is empty and returns false once it is closed and drained.
+*/
+namespace{
+
+template<typename T>
+class BoundedQueue{
+    public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity){}
+
+    void push(T item){
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [&]{ return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    bool pop(T& item){
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [&]{ return !items.empty() || closed; });
+        if(items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close(){
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    private:
+    size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+} //namespace
+
+Result<AddResult> MiniGitRepo::add(const std::string& filename){
+    Result<std::vector<AddResult>> added = add(std::vector<std::string>{filename});
+    if(!added) return added.error;
+    if(added.value.empty()){
+        //a directory with nothing changed under it
+        AddResult unchanged;
+        unchanged.path = filename;
+        return unchanged;
+    }
+    return added.value.front();
+}
+
+/*
+ add runs as a pipeline so reading, hashing and storing overlap:
+   readers (I/O bound)  -> read queue  -> hashers (one per core) -> write queue -> writer
+ Both queues are bounded, so at most a few dozen files are in memory at once. The
+ writer is the calling thread because the journal and object index are not shared;
+ it also streams large files through the chunker, since their chunks go straight
+ into the journal. Objects are not compressed, so there is no compression stage.
+*/
+Result<std::vector<AddResult>> MiniGitRepo::add(const std::vector<std::string>& paths){
+    if(!fs::exists(baseDir)) return notARepository();
+    if(paths.empty()) return Error{ErrorCode::InvalidArgument, "Nothing specified, nothing added."};
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+
+    //directories come from the stat-cache scan, which skips what .minigitignore excludes
+    std::vector<std::string> filenames, removals, dirs;
+    std::unordered_set<std::string> seen;
+    std::map<std::string, std::string> headFiles;
+    bool headLoaded = false;
+    for(std::string path : paths){
+        if(!fs::exists(path)){
+            //a tracked file that is gone is staged, so the next commit drops it from the tree
+            if(!headLoaded){
+                headFiles = loadTreeFiles(headCommit());
+                headLoaded = true;
+            }
+            std::vector<std::string> staged = readIndex();
+            if(headFiles.count(path) || std::find(staged.begin(), staged.end(), path) != staged.end()){
+                if(seen.insert(path).second) removals.push_back(path);
+                continue;
+            }
+            return Error{ErrorCode::NotFound, "File '" + path + "'does not exist."};
+        }
+        if(!fs::is_directory(path)){
+            if(seen.insert(path).second) filenames.push_back(path);
+            continue;
+        }
+        while(path.rfind("./", 0) == 0) path.erase(0, 2);
+        while(path.size() > 1 && path.back() == '/') path.pop_back();
+        if(path.empty()) path = ".";
+        dirs.push_back(path);
+    }
+
+    //a file under a directory whose stat data is unchanged is neither read nor hashed; one
+    //whose blob is already stored is staged by its hash, and only the rest is read
+    std::vector<AddResult> alreadyStored;
+    std::map<std::string, StatEntry> work;
+    std::string scanToken;
+    if(!dirs.empty()){
+        if(!headLoaded){
+            headFiles = loadTreeFiles(headCommit());
+            headLoaded = true;
+        }
+        std::vector<std::string> staged = readIndex();
+        std::set<std::string> stagedSet(staged.begin(), staged.end());
+        std::set<std::string> tracked = stagedSet;
+        for(const auto& entry : headFiles) tracked.insert(entry.first);
+        work = scanWorkingTree(tracked, &scanToken);
+
+        auto underDirs = [&](const std::string& name){
+            for(const auto& dir : dirs){
+                if(dir == "." || name == dir || name.rfind(dir + "/", 0) == 0) return true;
+            }
+            return false;
+        };
+        for(const auto& [name, entry] : work){
+            if(!underDirs(name) || seen.count(name)) continue;
+            if(!entry.hash.empty()){
+                auto committed = headFiles.find(name);
+                if(committed != headFiles.end() && committed->second == entry.hash && !stagedSet.count(name)) continue;
+                if(journalHas(objectPath(entry.hash)) || hasObject(entry.hash)){
+                    seen.insert(name);
+                    AddResult result;
+                    result.path = name;
+                    result.blob = entry.hash;
+                    alreadyStored.push_back(result);
+                    continue;
+                }
+            }
+            seen.insert(name);
+            filenames.push_back(name);
+        }
+
+        //committed files gone from under the directory are staged as removals, except
+        //where sparse checkout expects them to be absent
+        PathMatcher sparse;
+        bool isSparse = loadSparse(sparse);
+        for(const auto& [name, blob] : headFiles){
+            if(!underDirs(name) || work.count(name) || seen.count(name)) continue;
+            if(isSparse && !sparse.matchesPathOrParent(name, false)) continue;
+            seen.insert(name);
+            removals.push_back(name);
+        }
+    }
+    if(filenames.empty() && removals.empty() && alreadyStored.empty()) return std::vector<AddResult>();
+
+    struct Item{
+        size_t slot;
+        bool chunked = false;
+        std::string content;
+        std::string hash;
+    };
+    const size_t queueDepth = 64;
+    BoundedQueue<Item> readQueue(queueDepth), writeQueue(queueDepth);
+
+    unsigned readers = std::max<unsigned>(1, std::min<size_t>(4, filenames.size()));
+    unsigned hashers = std::max<unsigned>(1, std::min<size_t>(std::thread::hardware_concurrency(), filenames.size()));
+    std::atomic<size_t> next(0);
+    std::atomic<unsigned> readersLeft(readers), hashersLeft(hashers);
+    std::vector<std::thread> pool;
+
+    //Read file content, large files are left to the writer's chunker
+    for(unsigned r = 0; r < readers; ++r){
+        pool.emplace_back([&](){
+            size_t slot;
+            while((slot = next.fetch_add(1)) < filenames.size()){
+                Item item;
+                item.slot = slot;
+                std::error_code ec;
+                if(fs::file_size(filenames[slot], ec) >= chunkedThreshold && !ec){
+                    item.chunked = true;
+                }else{
+                    std::ifstream inFile(filenames[slot], std::ios::binary);
+                    item.content.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+                }
+                readQueue.push(std::move(item));
+            }
+            if(--readersLeft == 0) readQueue.close();
+        });
+    }
+    for(unsigned h = 0; h < hashers; ++h){
+        pool.emplace_back([&](){
+            Item item;
+            while(readQueue.pop(item)){
+                if(!item.chunked) item.hash = computeHash(item.content);
+                writeQueue.push(std::move(item));
+            }
+            if(--hashersLeft == 0) writeQueue.close();
+        });
+    }
+
+    //store blob if it doesn`t exist
+    std::vector<AddResult> results(filenames.size());
+    Item item;
+    while(writeQueue.pop(item)){
+        AddResult& result = results[item.slot];
+        result.path = filenames[item.slot];
+        if(item.chunked){
+            item.content = storeChunkedFile(result.path, result);
+            item.hash = computeHash(item.content);
+        }
+        result.blob = item.hash;
+        std::string blobPath = objectPath(item.hash);
+        if (!journalHas(blobPath) && !hasObject(item.hash)){
+            journalWrite(blobPath, std::move(item.content));
+            result.stored = true;
+        }
+    }
+    for(auto& t : pool) t.join();
+
+    //what was just hashed goes into the stat cache, so the next scan does not hash it again
+    if(!dirs.empty()){
+        for(const auto& result : results){
+            auto scanned = work.find(result.path);
+            if(scanned != work.end()) scanned->second.hash = result.blob;
+        }
+        saveStatCache(statCacheFile, work, scanToken);
+    }
+    for(const auto& result : alreadyStored){
+        results.push_back(result);
+        filenames.push_back(result.path);
+    }
+    for(const auto& path : removals){
+        AddResult removal;
+        removal.path = path;
+        removal.removed = true;
+        results.push_back(removal);
+        filenames.push_back(path);
+    }
+
+    //Append new filenames to the index; it is published by rename after the blobs
+    std::vector<std::string> staged = readIndex();
+    std::unordered_set<std::string> known(staged.begin(), staged.end());
+    std::string index;
+    for(const auto& name : staged) index += name + "\n";
+    bool changed = false;
+    for(const auto& filename : filenames){
+        if(known.insert(filename).second){
+            index += filename + "\n";
+            changed = true;
+        }
+    }
+    if(changed) journalRef(indexFile, index);
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+    return results;
+}
+
+static std::string_view trimView(std::string_view text){
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if(first == std::string_view::npos) return {};
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+/*
+ Binary commit encoding (native endian):
+   char[4] "MGCB", u32 version (2: the entries are the whole tree; 1: only the files
+   staged for that commit, the rest is inherited from its ancestors)
+   i64 epoch seconds
+   u32 parent count (0 or 1), u32 entry count, u32 message length, u32 author length
+   u64 parent ids
+   message bytes, author bytes
+   entry table: u64 blob, u32 path offset, u32 path length; sorted by path
+   path bytes
+ Commits written before this encoding are text and are still read by CommitView.
+*/
+const size_t commitHeaderSize = 32;
+const size_t commitEntrySize = 16;
+
+static std::string encodeCommit(const std::string& message, const std::string& author, int64_t epoch,
+                         const std::string& parent, const std::vector<CommitEntry>& entries){
+    uint64_t parentId = 0;
+    uint32_t parents = parseObjectId(parent, parentId) ? 1 : 0;
+    uint32_t version = 2, entryCount = entries.size(), messageLength = message.size(), authorLength = author.size();
+
+    std::string out(commitHeaderSize, '\0');
+    std::memcpy(&out[0], "MGCB", 4);
+    std::memcpy(&out[4], &version, 4);
+    std::memcpy(&out[8], &epoch, 8);
+    std::memcpy(&out[16], &parents, 4);
+    std::memcpy(&out[20], &entryCount, 4);
+    std::memcpy(&out[24], &messageLength, 4);
+    std::memcpy(&out[28], &authorLength, 4);
+    if(parents) out.append(reinterpret_cast<const char*>(&parentId), 8);
+    out += message;
+    out += author;
+
+    std::string pathData;
+    for(const auto& entry : entries){
+        uint32_t offset = pathData.size(), length = entry.path.size();
+        out.append(reinterpret_cast<const char*>(&entry.blob), 8);
+        out.append(reinterpret_cast<const char*>(&offset), 4);
+        out.append(reinterpret_cast<const char*>(&length), 4);
+        pathData += entry.path;
+    }
+    return out + pathData;
+}
+
+bool CommitView::parse(std::string_view data){
+    *this = CommitView();
+    if(data.size() >= commitHeaderSize && data.compare(0, 4, "MGCB") == 0){
+        uint32_t version, parents, entries, messageLength, authorLength;
+        std::memcpy(&version, data.data() + 4, 4);
+        std::memcpy(&epoch, data.data() + 8, 8);
+        std::memcpy(&parents, data.data() + 16, 4);
+        std::memcpy(&entries, data.data() + 20, 4);
+        std::memcpy(&messageLength, data.data() + 24, 4);
+        std::memcpy(&authorLength, data.data() + 28, 4);
+        size_t pos = commitHeaderSize;
+        size_t fixed = pos + uint64_t(parents) * 8 + messageLength + authorLength + uint64_t(entries) * commitEntrySize;
+        if(version < 1 || version > 2 || parents > 1 || fixed > data.size()) return false;
+        if(parents){
+            std::memcpy(&parentId, data.data() + pos, 8);
+            hasParent = true;
+            pos += 8;
+        }
+        messageText = data.substr(pos, messageLength);
+        pos += messageLength;
+        authorText = data.substr(pos, authorLength);
+        pos += authorLength;
+        entryTable = data.data() + pos;
+        entryCount = entries;
+        pathBytes = data.data() + fixed;
+        pathBytesSize = data.size() - fixed;
+        for(size_t i = 0; i < entryCount; ++i){
+            uint32_t offset, length;
+            std::memcpy(&offset, entryTable + i * commitEntrySize + 8, 4);
+            std::memcpy(&length, entryTable + i * commitEntrySize + 12, 4);
+            if(uint64_t(offset) + length > pathBytesSize) return false;
+        }
+        binary = true;
+        complete = version == 2;
+        return true;
+    }
+
+    //legacy text: header lines, then " name -> blob" lines after "files:"
+    bool section = false;
+    size_t pos = 0;
+    while(pos < data.size()){
+        size_t end = data.find('\n', pos);
+        if(end == std::string_view::npos) end = data.size();
+        std::string_view line = data.substr(pos, end - pos);
+        pos = end + 1;
+        if(!section){
+            if(trimView(line) == "files:") section = true;
+            else if(line.rfind("message:", 0) == 0) messageText = trimView(line.substr(8));
+            else if(line.rfind("author:", 0) == 0) authorText = trimView(line.substr(7));
+            else if(line.rfind("timestamp:", 0) == 0) timestampText = trimView(line.substr(10));
+            else if(line.rfind("parent:", 0) == 0) parentText = trimView(line.substr(7));
+            continue;
+        }
+        size_t arrow = line.find("->");
+        if(arrow == std::string_view::npos || arrow == 0) continue;
+        std::string_view name = trimView(line.substr(0, arrow - 1));
+        std::string_view blob = trimView(line.substr(arrow + 2));
+        uint64_t id = 0;
+        auto result = std::from_chars(blob.data(), blob.data() + blob.size(), id, 16);
+        if(name.empty() || result.ec != std::errc()) continue;
+        textEntries.push_back({name, id});
+    }
+    hasParent = parseObjectId(std::string(parentText), parentId);
+    return section;
+}
+
+//the commit time as ctime() prints it, without the newline
+std::string CommitView::timestamp() const{
+    if(!binary) return std::string(timestampText);
+    time_t when = epoch;
+    char buffer[32] = {0};
+    if(!ctime_r(&when, buffer)) return "";
+    std::string text(buffer);
+    while(!text.empty() && text.back() == '\n') text.pop_back();
+    return text;
+}
+
+std::string CommitView::parent() const{
+    return hasParent ? formatObjectId(parentId) : "null";
+}
+
+CommitEntry CommitView::entry(size_t i) const{
+    if(!binary) return textEntries[i];
+    CommitEntry result;
+    uint32_t offset, length;
+    std::memcpy(&result.blob, entryTable + i * commitEntrySize, 8);
+    std::memcpy(&offset, entryTable + i * commitEntrySize + 8, 4);
+    std::memcpy(&length, entryTable + i * commitEntrySize + 12, 4);
+    result.path = std::string_view(pathBytes + offset, length);
+    return result;
+}
+
+MappedCommit::~MappedCommit(){
+    if(map) ::munmap(map, mapSize);
+}
+
+bool MappedCommit::open(const std::string& file){
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || st.st_size == 0){
+        ::close(fd);
+        return false;
+    }
+    void* mem = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) return false;
+    map = mem;
+    mapSize = st.st_size;
+    return commit.parse(std::string_view(static_cast<const char*>(map), mapSize));
+}
+
+bool MappedCommit::load(std::string_view data){
+    return commit.parse(data);
+}
+
+//a commit from the journal when it is still pending, otherwise mapped from disk
+bool MiniGitRepo::readCommit(const std::string& hash, MappedCommit& commit) const{
+    if(hash == "null" || hash.empty()) return false;
+    std::string commitPath = baseDir + "/commits/" + hash + ".txt";
+    for(auto it = journalEntries.rbegin(); it != journalEntries.rend(); ++it){
+        if(it->path == commitPath) return commit.load(it->content);
+    }
+    return commit.open(commitPath);
+}
+
+//files of a commit, including one that is still waiting in the journal
+std::map<std::string, std::string> MiniGitRepo::loadCommitFiles(const std::string& hash) const{
+    std::map<std::string, std::string> files;
+    MappedCommit commit;
+    if(!readCommit(hash, commit)) return files;
+    const CommitView& view = commit.view();
+    for(size_t i = 0; i < view.size(); ++i){
+        CommitEntry entry = view.entry(i);
+        files[std::string(entry.path)] = formatObjectId(entry.blob);
+    }
+    return files;
+}
+
+/*
+ Changed-path Bloom filters. commit-paths is an append-only file of records:
+   u64 commit id, u64 parent id, u8 hasParent, u32 filterBytes, filter bytes
+ Every changed path and each of its leading directories is added to the filter,
+ so "log -- dir" can use it too. filterBytes == 0 means "too many paths, always check".
+*/
+const size_t maxFilteredPaths = 512;
+const uint32_t pathFilterHashes = 7;
+
+//paths a commit changed against its parent's tree; a path the commit does not list is only
+//a deletion when the commit is complete, an older commit just did not stage it
+static std::vector<std::string> changedPaths(const std::map<std::string, std::string>& parentFiles,
+                                      const std::map<std::string, std::string>& files, bool complete){
+    std::vector<std::string> changed;
+    for(const auto& [name, blob] : files){
+        auto it = parentFiles.find(name);
+        if(it == parentFiles.end() || it->second != blob) changed.push_back(name);
+    }
+    if(!complete) return changed;
+    for(const auto& entry : parentFiles){
+        if(!files.count(entry.first)) changed.push_back(entry.first);
+    }
+    return changed;
+}
+
+static void pathFilterPositions(const std::string& path, size_t bitCount, std::vector<size_t>& out){
+    uint64_t h1 = std::hash<std::string>{}(path);
+    uint64_t h2 = mixId(h1) | 1;
+    out.clear();
+    for(uint32_t i = 0; i < pathFilterHashes; ++i){
+        out.push_back((h1 + i * h2) % bitCount);
+    }
+}
+
+static bool pathFilterMayContain(const PathFilter& filter, const std::string& path){
+    if(filter.bits.empty()) return true;
+    std::vector<size_t> positions;
+    pathFilterPositions(path, filter.bits.size() * 8, positions);
+    for(size_t bit : positions){
+        if(!(static_cast<unsigned char>(filter.bits[bit >> 3]) & (1u << (bit & 7)))) return false;
+    }
+    return true;
+}
+
+static std::unordered_map<uint64_t, PathFilter> loadPathFilters(const std::string& file){
+    std::unordered_map<uint64_t, PathFilter> filters;
+    std::ifstream in(file, std::ios::binary);
+    uint64_t id;
+    while(in.read(reinterpret_cast<char*>(&id), sizeof(id))){
+        PathFilter filter;
+        unsigned char hasParent = 0;
+        uint32_t size = 0;
+        in.read(reinterpret_cast<char*>(&filter.parent), sizeof(filter.parent));
+        in.read(reinterpret_cast<char*>(&hasParent), 1);
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        filter.bits.resize(size);
+        if(size > 0) in.read(&filter.bits[0], size);
+        if(!in) break; //torn tail record
+        filter.hasParent = hasParent != 0;
+        filters[id] = std::move(filter);
+    }
+    return filters;
+}
+
+//path (or directory) touched by a commit relative to its parent
+static bool pathChanged(const std::vector<std::string>& changed, const std::string& path){
+    for(const auto& name : changed){
+        if(name == path) return true;
+        if(name.size() > path.size() && name.compare(0, path.size(), path) == 0 && name[path.size()] == '/') return true;
+    }
+    return false;
+}
+
+//author recorded in new commits: $MINIGIT_AUTHOR, else the login name
+static std::string commitAuthor(){
+    for(const char* var : {"MINIGIT_AUTHOR", "USER", "LOGNAME"}){
+        const char* value = std::getenv(var);
+        if(value && *value) return value;
+    }
+    return "unknown";
+}
+
+//lowercased alphanumeric words: the unit both the index and the query are split into
+static std::vector<std::string> messageTerms(const std::string& text){
+    std::vector<std::string> terms;
+    std::string word;
+    for(char c : text + " "){
+        if(std::isalnum(static_cast<unsigned char>(c))){
+            word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }else if(!word.empty()){
+            terms.push_back(word);
+            word.clear();
+        }
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    return terms;
+}
+
+//message and author words live in separate term spaces
+static uint64_t termId(char field, const std::string& word){
+    return mixId(std::hash<std::string>{}(std::string(1, field) + ":" + word));
+}
+
+void MiniGitRepo::recordLogTerms(const std::string& commitHash, const std::string& message, const std::string& author){
+    uint64_t id;
+    if(!parseObjectId(commitHash, id)) return;
+    std::vector<Posting> postings;
+    for(const auto& word : messageTerms(message)) postings.push_back({termId('m', word), id});
+    for(const auto& word : messageTerms(author)) postings.push_back({termId('a', word), id});
+    //without an index yet the next --grep builds one from the commits themselves
+    if(postings.empty() || !logIndex.available()) return;
+    journalAppend(logIndexFile + ".log",
+                  std::string(reinterpret_cast<const char*>(postings.data()), postings.size() * sizeof(Posting)));
+}
+
+//index every commit on disk; used when the repository predates the index
+void MiniGitRepo::rebuildLogIndex(){
+    std::vector<Posting> postings;
+    std::error_code ec;
+    for(const auto& entry : fs::directory_iterator(baseDir + "/commits", ec)){
+        std::string name = entry.path().filename().string();
+        uint64_t id;
+        if(entry.path().extension() != ".txt" || !parseObjectId(name.substr(0, name.size() - 4), id)) continue;
+        MappedCommit commit;
+        if(!commit.open(entry.path().string())) continue;
+        for(const auto& word : messageTerms(std::string(commit.view().message()))) postings.push_back({termId('m', word), id});
+        for(const auto& word : messageTerms(std::string(commit.view().author()))) postings.push_back({termId('a', word), id});
+    }
+    logIndex.rebuild(postings);
+}
+
+void MiniGitRepo::recordChangedPaths(const std::string& commitHash, const std::string& parentHash,
+                                     const std::vector<std::string>& changed){
+    uint64_t id, parent = 0;
+    if(!parseObjectId(commitHash, id)) return;
+    bool hasParent = parseObjectId(parentHash, parent);
+
+    std::set<std::string> keys;
+    for(const auto& name : changed){
+        keys.insert(name);
+        for(size_t slash = name.find('/'); slash != std::string::npos; slash = name.find('/', slash + 1)){
+            keys.insert(name.substr(0, slash));
+        }
+    }
+
+    //about 10 bits per key, none at all when the commit is too wide to be worth filtering
+    std::string bits;
+    if(keys.size() <= maxFilteredPaths){
+        bits.assign(std::max<size_t>(8, (keys.size() * 10 + 7) / 8), '\0');
+        std::vector<size_t> positions;
+        for(const auto& key : keys){
+            pathFilterPositions(key, bits.size() * 8, positions);
+            for(size_t bit : positions) bits[bit >> 3] |= static_cast<char>(1u << (bit & 7));
+        }
+    }
+
+    std::string record;
+    unsigned char flag = hasParent ? 1 : 0;
+    uint32_t size = bits.size();
+    record.append(reinterpret_cast<const char*>(&id), sizeof(id));
+    record.append(reinterpret_cast<const char*>(&parent), sizeof(parent));
+    record.append(reinterpret_cast<const char*>(&flag), 1);
+    record.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    record += bits;
+    journalAppend(pathFilterFile, record);
+}
+
+Result<CommitResult> MiniGitRepo::commit(const std::string& message){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    //HEAD -> refs/main -> current commit hash
+    std::string headRef = readRef(headFile);
+
+    std::string branch = headRef.substr(5);
+    std::string branchPath= baseDir + "/" + branch;
+
+    std::string parentHash = readRef(branchPath);
+
+    time_t now = time(0);
+    std::string timestamp = ctime(&now);
+    std::string combined = message + timestamp;
+    std::string commitHash = computeHash(combined);
+
+    //create commit file
+    fs::create_directory(baseDir + "/commits");
+    std::string commitPath = baseDir + "/commits/" + commitHash + ".txt";
+
+    std::string author = commitAuthor();
+    CommitResult result;
+    result.hash = commitHash;
+
+    //the parent's tree carries forward: staged files replace their entries, and staged
+    //files that no longer exist leave the tree
+    std::map<std::string, std::string> parentFiles = loadTreeFiles(parentHash);
+    std::map<std::string, std::string> committedFiles = parentFiles;
+    for(const auto& filename : readIndex()){
+        if (!fs::exists(filename)) {
+            if(committedFiles.erase(filename)) result.removed.push_back(filename);
+            else result.skipped.push_back(filename);
+            continue;
+        }
+
+        std::string hash = hashWorkingFile(filename);
+        committedFiles[filename] = hash;
+    }
+
+    std::vector<CommitEntry> entries;
+    for(const auto& [name, hash] : committedFiles){
+        uint64_t blob = 0;
+        if(parseObjectId(hash, blob)) entries.push_back({name, blob});
+    }
+
+    //commit file, branch pointer and the cleared index are published together by the journal
+    journalWrite(commitPath, encodeCommit(message, author, now, parentHash, entries));
+    journalRef(branchPath, commitHash);
+    journalRef(indexFile, "");
+    recordChangedPaths(commitHash, parentHash, changedPaths(parentFiles, committedFiles, true));
+    recordLogTerms(commitHash, message, author);
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+    return result;
+}
+
+Result<CommitIterator> MiniGitRepo::log(const LogFilter& filter) {
+    if (!fs::exists(baseDir)) return notARepository();
+    // Step 1: Read HEAD to get current branch
+    std::string headRef = readRef(headFile);  // e.g., "ref: refs/main"
+
+    std::string branch = headRef.substr(5);  // remove "ref: "
+    std::string branchPath = baseDir + "/" + branch;
+
+    // Step 2: Get latest commit hash
+    CommitIterator it;
+    it.repo = this;
+    it.current = readRef(branchPath);
+
+    if (it.current == "null" || it.current.empty()) {
+        return Error{ErrorCode::NoCommits, "No commits yet."};
+    }
+
+    // Path-limited log: changed-path filters let us step over commits without opening them
+    it.limit = filter.path;
+    if (it.limit.rfind("./", 0) == 0) it.limit = it.limit.substr(2);
+    while (it.limit.size() > 1 && it.limit.back() == '/') it.limit.pop_back();
+    if (!it.limit.empty()) it.filters = loadPathFilters(pathFilterFile);
+
+    // --grep/--author: intersect the posting lists of every word to get the candidate commits
+    it.grepTerms = messageTerms(filter.grep);
+    it.authorTerms = messageTerms(filter.author);
+    it.filtered = !it.grepTerms.empty() || !it.authorTerms.empty();
+    // a repository that predates the index builds it once, under the lock so no commit written
+    // meanwhile is missed; a reader that cannot take the lock walks the history instead
+    if (it.filtered && !logIndex.available() && lockForWrite().code == ErrorCode::None && !logIndex.available()) {
+        rebuildLogIndex();
+    }
+    it.indexed = it.filtered && logIndex.available();
+    if (it.indexed) {
+        std::vector<uint64_t> terms;
+        for (const auto& word : it.grepTerms) terms.push_back(termId('m', word));
+        for (const auto& word : it.authorTerms) terms.push_back(termId('a', word));
+        for (size_t t = 0; t < terms.size(); ++t) {
+            std::vector<uint64_t> posting = logIndex.lookup(terms[t]);
+            if (t == 0) {
+                it.candidates = std::move(posting);
+                continue;
+            }
+            std::vector<uint64_t> both;
+            std::set_intersection(it.candidates.begin(), it.candidates.end(), posting.begin(), posting.end(),
+                                  std::back_inserter(both));
+            it.candidates = std::move(both);
+        }
+        if (it.filters.empty()) it.filters = loadPathFilters(pathFilterFile);
+    }
+    return it;
+}
+
+// Step 3: Follow the parent chain and yield the next commit the filters let through
+bool CommitIterator::next(CommitInfo& info) {
+    while (repo && failure.code == ErrorCode::None && current != "null" && !current.empty()) {
+        if (indexed) {
+            // not a candidate: step to the parent without opening the commit when a filter record has it
+            uint64_t id = 0;
+            if (!parseObjectId(current, id) || !std::binary_search(candidates.begin(), candidates.end(), id)) {
+                auto found = filters.find(id);
+                if (found != filters.end()) {
+                    current = found->second.hasParent ? formatObjectId(found->second.parent) : "null";
+                } else {
+                    current = repo->commitParent(current);
+                }
+                continue;
+            }
+        }
+        if (!limit.empty()) {
+            uint64_t id;
+            auto found = parseObjectId(current, id) ? filters.find(id) : filters.end();
+            if (found != filters.end() && !pathFilterMayContain(found->second, limit)) {
+                current = found->second.hasParent ? formatObjectId(found->second.parent) : "null";
+                continue;
+            }
+        }
+
+        MappedCommit commit;
+        if (!repo->readCommit(current, commit)) {
+            failure = Error{ErrorCode::NotFound,
+                            "Commit file not found: " + repo->baseDir + "/commits/" + current + ".txt"};
+            return false;
+        }
+        const CommitView& view = commit.view();
+        std::string message(view.message()), commitAuthorName(view.author()), parent = view.parent();
+
+        // Bloom hit (or no filter recorded): confirm against the real file lists
+        if (!limit.empty() &&
+            !pathChanged(changedPaths(repo->loadTreeFiles(parent), repo->loadCommitFiles(current), view.isComplete()),
+                         limit)) {
+            current = parent;
+            continue;
+        }
+
+        // posting lists can collide on term hashes, so the words are confirmed against the commit itself
+        if (filtered) {
+            std::vector<std::string> messageWords = messageTerms(message), authorWords = messageTerms(commitAuthorName);
+            if (!std::includes(messageWords.begin(), messageWords.end(), grepTerms.begin(), grepTerms.end()) ||
+                !std::includes(authorWords.begin(), authorWords.end(), authorTerms.begin(), authorTerms.end())) {
+                current = parent;
+                continue;
+            }
+        }
+
+        info.hash = current;
+        info.message = std::move(message);
+        info.author = std::move(commitAuthorName);
+        info.timestamp = view.timestamp();
+        info.parent = parent;
+        current = parent;
+        return true;
+    }
+    return false;
+}
+
+Result<std::string> MiniGitRepo::branch(const std::string& branchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    //Get current branch from HEAD
+    std::string headRef = readRef(headFile);
+
+    std::string currentBranchPath= baseDir + "/" + headRef.substr(5);  //remove "ref: "
+    std::string currentCommitHash = readRef(currentBranchPath);
+
+    std::string newBranchPath = refsDir + "/" + branchName;
+
+    //check if branch already exists
+    if(fs::exists(newBranchPath) || journalHas(newBranchPath)){
+        return Error{ErrorCode::AlreadyExists, "Branch '" + branchName + "'already exists."};
+    }
+
+    //create the new branch file and point it to current commit
+    journalRef(newBranchPath, currentCommitHash);
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+    return currentCommitHash;
+}
+
+Result<CheckoutResult> MiniGitRepo::checkout(const std::string& branchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    std::string newBranchPath = refsDir + "/" + branchName;
+
+    if(!fs::exists(newBranchPath) && !journalHas(newBranchPath)){
+        return Error{ErrorCode::UnknownBranch, "Branch '" + branchName + "' does not exist."};
+    }
+    std::string owner = checkedOutIn(branchName);
+    std::string here = dirs.linked ? readRef(dirs.worktree + "/path") : fs::path(baseDir).parent_path().string();
+    if(!owner.empty() && owner != here){
+        return Error{ErrorCode::AlreadyExists, "Branch '" + branchName + "' is checked out in " + owner + "."};
+    }
+
+    //update HEAD to point to the new branch
+    journalRef(headFile, "ref: refs/" + branchName + "\n");
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+
+    //Read the latest commit hash from the branch
+    CheckoutResult result;
+    std::string latestCommitHash = readRef(newBranchPath);
+
+    //restore every file of the commit's tree
+    MappedCommit commit;
+    if(latestCommitHash == "null" || latestCommitHash.empty() || !readCommit(latestCommitHash, commit)){
+        return result;
+    }
+    result.commit = latestCommitHash;
+    PathMatcher sparse;
+    bool isSparse = loadSparse(sparse);
+    PathTable paths;
+    for(const auto& entry : loadTree(latestCommitHash, paths).entries){
+        std::string filename(paths.path(entry.path));
+        if(isSparse && !sparse.matchesPathOrParent(filename, false)){
+            ++result.skipped;
+            continue;
+        }
+        result.files.push_back({filename, restoreBlob(formatObjectId(entry.blob), filename)});
+    }
+    return result;
+}
+
+/*
+ Sparse checkout: .minigit/sparse-checkout holds patterns in .minigitignore syntax.
+ A path is in the checkout when it, or one of its directories, matches. checkout
+ only restores those paths and status only reports on them; commits and merges
+ still work on whole snapshots.
+*/
+bool MiniGitRepo::loadSparse(PathMatcher& sparse) const{
+    return sparse.load(sparseFile) && !sparse.empty();
+}
+
+std::vector<std::string> MiniGitRepo::sparsePatterns() const{
+    std::vector<std::string> patterns;
+    std::ifstream in(sparseFile);
+    std::string line;
+    while(std::getline(in, line)){
+        if(!line.empty()) patterns.push_back(line);
+    }
+    return patterns;
+}
+
+//store new patterns (none turns sparse checkout off) and bring the working tree in line with them
+Result<CheckoutResult> MiniGitRepo::setSparsePatterns(const std::vector<std::string>& patterns){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    std::string text;
+    for(const auto& pattern : patterns) text += pattern + "\n";
+    journalRef(sparseFile, text);
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+
+    CheckoutResult result;
+    result.commit = headCommit();
+    MappedCommit commit;
+    if(result.commit == "null" || !readCommit(result.commit, commit)){
+        result.commit.clear();
+        return result;
+    }
+    PathMatcher sparse;
+    bool isSparse = loadSparse(sparse);
+    PathTable paths;
+    for(const auto& entry : loadTree(result.commit, paths).entries){
+        std::string filename(paths.path(entry.path)), blob = formatObjectId(entry.blob);
+        bool present = fs::exists(filename);
+        if(!isSparse || sparse.matchesPathOrParent(filename, false)){
+            if(!present) result.files.push_back({filename, restoreBlob(blob, filename)});
+            continue;
+        }
+        ++result.skipped;
+        //only files identical to the commit are removed, local edits stay
+        if(!present || hashWorkingFile(filename) != blob) continue;
+        fs::remove(filename);
+        result.removed.push_back(filename);
+        std::error_code ec;
+        for(fs::path dir = fs::path(filename).parent_path(); !dir.empty() && fs::is_empty(dir, ec); dir = dir.parent_path()){
+            fs::remove(dir, ec);
+        }
+    }
+    return result;
+}
+
+/*
+ Linked worktrees: worktrees/<name>/ in the common directory holds the worktree's
+ HEAD and index plus a "path" file naming its directory, whose .minigit file points
+ back here. Objects, commits and refs are shared, so a branch may only be checked
+ out in one worktree at a time.
+*/
+Result<CheckoutResult> MiniGitRepo::addWorktree(const std::string& path, const std::string& branchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    std::string branchPath = refsDir + "/" + branchName;
+    if(!fs::exists(branchPath) && !journalHas(branchPath)){
+        return Error{ErrorCode::UnknownBranch, "Branch '" + branchName + "' does not exist."};
+    }
+    std::string owner = checkedOutIn(branchName);
+    if(!owner.empty()){
+        return Error{ErrorCode::AlreadyExists, "Branch '" + branchName + "' is checked out in " + owner + "."};
+    }
+    std::error_code ec;
+    if(fs::exists(path) && !fs::is_empty(path, ec)){
+        return Error{ErrorCode::AlreadyExists, "'" + path + "' already exists and is not empty."};
+    }
+
+    fs::path root = fs::absolute(path).lexically_normal();
+    if(!root.has_filename()) root = root.parent_path();
+    std::string name = root.filename().string();
+    for(int n = 1; fs::exists(worktreesDir + "/" + name); ++n) name = root.filename().string() + std::to_string(n);
+    std::string privateDir = worktreesDir + "/" + name;
+    fs::create_directories(privateDir);
+    fs::create_directories(root);
+
+    //the worktree only becomes visible once its HEAD and link file are published
+    journalRef(privateDir + "/index", "");
+    journalRef(privateDir + "/path", root.string() + "\n");
+    journalRef(privateDir + "/HEAD", "ref: refs/" + branchName + "\n");
+    journalRef((root / workTreeEntry).string(), "minigitdir: " + privateDir + "\n");
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+
+    CheckoutResult result;
+    std::string tip = readRef(branchPath);
+    MappedCommit commit;
+    if(tip == "null" || tip.empty() || !readCommit(tip, commit)) return result;
+    result.commit = tip;
+    PathTable paths;
+    for(const auto& entry : loadTree(tip, paths).entries){
+        std::string filename(paths.path(entry.path));
+        result.files.push_back({filename, restoreBlob(formatObjectId(entry.blob), (root / filename).string())});
+    }
+    return result;
+}
+
+//the main worktree first, then the linked ones by name
+Result<std::vector<WorktreeInfo>> MiniGitRepo::worktrees() const{
+    if(!fs::exists(baseDir)) return notARepository();
+    auto branchOf = [&](const std::string& head){
+        std::string ref = readRef(head);
+        return ref.rfind("ref: refs/", 0) == 0 ? ref.substr(10) : ref;
+    };
+    std::vector<WorktreeInfo> list;
+    std::string mainHead = baseDir + "/HEAD";
+    list.push_back({fs::path(baseDir).parent_path().string(), branchOf(mainHead), false});
+
+    std::vector<std::string> names;
+    if(fs::is_directory(worktreesDir)){
+        for(const auto& entry : fs::directory_iterator(worktreesDir)) names.push_back(entry.path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+    for(const auto& name : names){
+        std::string privateDir = worktreesDir + "/" + name;
+        list.push_back({readRef(privateDir + "/path"), branchOf(privateDir + "/HEAD"), true});
+    }
+    return list;
+}
+
+//staged files of every worktree, as paths usable from this one; their blobs must survive prune
+std::vector<std::string> MiniGitRepo::stagedInAllWorktrees() const{
+    std::vector<std::string> staged = readIndex();
+    std::vector<std::pair<std::string, std::string>> others{{fs::path(baseDir).parent_path().string(), baseDir}};
+    if(fs::is_directory(worktreesDir)){
+        for(const auto& entry : fs::directory_iterator(worktreesDir)){
+            others.push_back({readRef(entry.path().string() + "/path"), entry.path().string()});
+        }
+    }
+    for(const auto& [root, dir] : others){
+        if(dir + "/index" == indexFile) continue;
+        std::ifstream in(dir + "/index");
+        std::string line;
+        while(std::getline(in, line)){
+            if(!line.empty()) staged.push_back(root + "/" + line);
+        }
+    }
+    return staged;
+}
+
+//directory of the worktree whose HEAD is on branchName, "" when none is
+std::string MiniGitRepo::checkedOutIn(const std::string& branchName) const{
+    Result<std::vector<WorktreeInfo>> all = worktrees();
+    for(const auto& tree : all.value){
+        if(tree.branch == branchName) return tree.path;
+    }
+    return "";
+}
+
+std::string_view Arena::copy(std::string_view text){
+    char* dest;
+    if(text.size() > blockSize){
+        //oversized strings get a block of their own, the current block keeps filling
+        blocks.emplace(blocks.begin(), new char[text.size()]);
+        dest = blocks.front().get();
+    }else{
+        if(text.size() > blockSize - used){
+            blocks.emplace_back(new char[blockSize]);
+            used = 0;
+        }
+        dest = blocks.back().get() + used;
+        used += text.size();
+    }
+    std::memcpy(dest, text.data(), text.size());
+    return std::string_view(dest, text.size());
+}
+
+uint32_t PathTable::intern(std::string_view path){
+    auto found = ids.find(path);
+    if(found != ids.end()) return found->second;
+    std::string_view stored = arena.copy(path);
+    uint32_t id = paths.size();
+    paths.push_back(stored);
+    ids.emplace(stored, id);
+    return id;
+}
+
+//files of a decoded commit as a sorted snapshot
+static Snapshot snapshotOf(const CommitView& view, PathTable& paths){
+    Snapshot snap;
+    snap.entries.reserve(view.size());
+    for(size_t i = 0; i < view.size(); ++i){
+        CommitEntry entry = view.entry(i);
+        snap.entries.push_back({paths.intern(entry.path), entry.blob});
+    }
+    if(view.isBinary()) return snap; //written sorted and unique
+
+    std::stable_sort(snap.entries.begin(), snap.entries.end(), [&](const SnapshotEntry& a, const SnapshotEntry& b){
+        return paths.path(a.path) < paths.path(b.path);
+    });
+
+    //a path listed twice keeps its last entry, like the map-based parsers did
+    size_t kept = 0;
+    for(size_t i = 0; i < snap.entries.size(); ++i){
+        if(kept > 0 && snap.entries[kept - 1].path == snap.entries[i].path) --kept;
+        snap.entries[kept++] = snap.entries[i];
+    }
+    snap.entries.resize(kept);
+    return snap;
+}
+
+Snapshot MiniGitRepo::loadSnapshot(const std::string& hash, PathTable& paths) const{
+    MappedCommit commit;
+    if(!readCommit(hash, commit)) return {};
+    return snapshotOf(commit.view(), paths);
+}
+
+//the whole tree at a commit; one written before commits were complete lists only what
+//was staged for it, so its ancestors fill in the rest up to a complete commit or the root
+Snapshot MiniGitRepo::loadTree(const std::string& hash, PathTable& paths) const{
+    Snapshot tree;
+    for(std::string current = hash; current != "null" && !current.empty();){
+        MappedCommit commit;
+        if(!readCommit(current, commit)) break;
+        const CommitView& view = commit.view();
+        Snapshot older = snapshotOf(view, paths);
+        if(tree.entries.empty()){
+            tree = std::move(older);
+        }else{
+            //entries already taken from a newer commit win
+            Snapshot merged;
+            merged.entries.reserve(tree.entries.size() + older.entries.size());
+            size_t i = 0, j = 0;
+            while(i < tree.entries.size() || j < older.entries.size()){
+                int order = i == tree.entries.size() ? 1 : j == older.entries.size() ? -1 :
+                            paths.path(tree.entries[i].path).compare(paths.path(older.entries[j].path));
+                if(order <= 0){
+                    merged.entries.push_back(tree.entries[i++]);
+                    if(order == 0) ++j;
+                }else{
+                    merged.entries.push_back(older.entries[j++]);
+                }
+            }
+            tree = std::move(merged);
+        }
+        if(view.isComplete()) break;
+        current = view.parent();
+    }
+    return tree;
+}
+
+std::map<std::string, std::string> MiniGitRepo::loadTreeFiles(const std::string& hash) const{
+    std::map<std::string, std::string> files;
+    PathTable paths;
+    for(const auto& entry : loadTree(hash, paths).entries){
+        files.emplace(paths.path(entry.path), formatObjectId(entry.blob));
+    }
+    return files;
+}
+
+/*
+ Three-way merge of sorted trees in one linear pass. A path absent from a tree is
+ deleted there, the same rule diff and rename detection use. A path changed (or
+ deleted) on only one side since base takes that side; changed differently on both
+ sides is a conflict and keeps ours, or theirs when ours deleted it.
+*/
+static TreeMerge mergeSnapshots(const Snapshot& base, const Snapshot& ours, const Snapshot& theirs, const PathTable& paths){
+    TreeMerge result;
+    result.merged.entries.reserve(std::max(ours.entries.size(), theirs.entries.size()));
+    const auto& baseFiles = base.entries;
+    const auto& ourFiles = ours.entries;
+    const auto& theirFiles = theirs.entries;
+    size_t b = 0, o = 0, t = 0;
+    while(b < baseFiles.size() || o < ourFiles.size() || t < theirFiles.size()){
+        //the smallest path still ahead of any of the three cursors
+        const SnapshotEntry* next = nullptr;
+        for(const SnapshotEntry* entry : {b < baseFiles.size() ? &baseFiles[b] : nullptr,
+                                          o < ourFiles.size() ? &ourFiles[o] : nullptr,
+                                          t < theirFiles.size() ? &theirFiles[t] : nullptr}){
+            if(entry && (!next || paths.path(entry->path) < paths.path(next->path))) next = entry;
+        }
+        uint32_t file = next->path;
+        const SnapshotEntry* inBase = b < baseFiles.size() && baseFiles[b].path == file ? &baseFiles[b++] : nullptr;
+        const SnapshotEntry* ourEntry = o < ourFiles.size() && ourFiles[o].path == file ? &ourFiles[o++] : nullptr;
+        const SnapshotEntry* theirEntry = t < theirFiles.size() && theirFiles[t].path == file ? &theirFiles[t++] : nullptr;
+
+        auto same = [](const SnapshotEntry* x, const SnapshotEntry* y){
+            return x == y || (x && y && x->blob == y->blob);
+        };
+        const SnapshotEntry* kept;
+        if(same(ourEntry, theirEntry) || same(theirEntry, inBase)){
+            kept = ourEntry;
+        }else if(same(ourEntry, inBase)){
+            kept = theirEntry;
+        }else{
+            result.conflicts.emplace_back(paths.path(file));
+            kept = ourEntry ? ourEntry : theirEntry;
+        }
+        if(kept) result.merged.entries.push_back(*kept);
+    }
+    return result;
+}
+
+//paths whose entry differs between a parent tree and a child tree; absent means deleted
+static std::vector<std::string> snapshotChanges(const Snapshot& parent, const Snapshot& child, const PathTable& paths){
+    std::vector<std::string> changed;
+    size_t p = 0, c = 0;
+    while(p < parent.entries.size() || c < child.entries.size()){
+        int order = p == parent.entries.size() ? 1 : c == child.entries.size() ? -1 :
+                    paths.path(parent.entries[p].path).compare(paths.path(child.entries[c].path));
+        if(order < 0){
+            changed.emplace_back(paths.path(parent.entries[p++].path));
+        }else if(order > 0){
+            changed.emplace_back(paths.path(child.entries[c++].path));
+        }else{
+            if(parent.entries[p].blob != child.entries[c].blob) changed.emplace_back(paths.path(child.entries[c].path));
+            ++p;
+            ++c;
+        }
+    }
+    return changed;
+}
+
+//MinHash sketch of a blob's lines: the minimum of 32 independently mixed line hashes
+static const int sketchSize = 32;
+static const int sketchBands = 8;
+using Sketch = std::array<uint64_t, sketchSize>;
+
+static bool sketchBlob(const std::string& text, Sketch& sketch){
+    sketch.fill(~0ULL);
+    bool any = false;
+    size_t pos = 0;
+    while(pos < text.size()){
+        size_t end = text.find('\n', pos);
+        if(end == std::string::npos) end = text.size();
+        if(end > pos){
+            uint64_t h = std::hash<std::string_view>{}(std::string_view(text).substr(pos, end - pos));
+            for(int k = 0; k < sketchSize; ++k){
+                sketch[k] = std::min(sketch[k], mixId(h + uint64_t(k) * 0x9E3779B97F4A7C15ULL));
+            }
+            any = true;
+        }
+        pos = end + 1;
+    }
+    return any;
+}
+
+/*
+ Rename and copy detection between two snapshots. Exact blob matches pair up first;
+ the remaining deleted and added files are MinHash-sketched on a worker per core and
+ bucketed by bands of the sketch (LSH), so only files sharing a band are compared.
+ Pairs estimated at 50% similar or more are assigned greedily, best first.
+ Both snapshots are whole trees (see loadTree), so a path only in from was deleted.
+*/
+std::vector<Rename> MiniGitRepo::detectRenames(const Snapshot& from, const Snapshot& to, const PathTable& paths) const{
+    std::vector<const SnapshotEntry*> deleted, added;
+    size_t i = 0, j = 0;
+    while(i < from.entries.size() || j < to.entries.size()){
+        int order = i == from.entries.size() ? 1 : j == to.entries.size() ? -1 :
+                    paths.path(from.entries[i].path).compare(paths.path(to.entries[j].path));
+        if(order < 0) deleted.push_back(&from.entries[i++]);
+        else if(order > 0) added.push_back(&to.entries[j++]);
+        else{ ++i; ++j; }
+    }
+    std::vector<Rename> renames;
+    if(added.empty()) return renames;
+
+    //stage one: identical blobs, preferring a deleted source over a copy of a kept one
+    std::unordered_map<uint64_t, std::vector<size_t>> deletedByBlob;
+    for(size_t d = 0; d < deleted.size(); ++d) deletedByBlob[deleted[d]->blob].push_back(d);
+    std::unordered_map<uint64_t, uint32_t> keptByBlob;
+    for(const auto& entry : from.entries) keptByBlob.emplace(entry.blob, entry.path);
+
+    std::vector<char> deletedUsed(deleted.size(), 0), addedUsed(added.size(), 0);
+    for(size_t a = 0; a < added.size(); ++a){
+        auto it = deletedByBlob.find(added[a]->blob);
+        if(it != deletedByBlob.end()){
+            for(size_t d : it->second){
+                if(deletedUsed[d]) continue;
+                deletedUsed[d] = addedUsed[a] = 1;
+                renames.push_back({deleted[d]->path, added[a]->path, 100, false});
+                break;
+            }
+        }
+        auto kept = keptByBlob.find(added[a]->blob);
+        if(!addedUsed[a] && kept != keptByBlob.end()){
+            addedUsed[a] = 1;
+            renames.push_back({kept->second, added[a]->path, 100, true});
+        }
+    }
+
+    //stage two: similarity sketches for whatever is still unpaired
+    std::vector<const SnapshotEntry*> sources, targets;
+    for(size_t d = 0; d < deleted.size(); ++d) if(!deletedUsed[d]) sources.push_back(deleted[d]);
+    for(size_t a = 0; a < added.size(); ++a) if(!addedUsed[a]) targets.push_back(added[a]);
+    if(sources.empty() || targets.empty()) return renames;
+
+    std::vector<const SnapshotEntry*> all(sources);
+    all.insert(all.end(), targets.begin(), targets.end());
+    std::vector<Sketch> sketches(all.size());
+    std::vector<char> valid(all.size(), 0);
+    std::atomic<size_t> next(0);
+    unsigned workers = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), all.size()));
+    std::vector<std::thread> pool;
+    for(unsigned w = 0; w < workers; ++w){
+        pool.emplace_back([&](){
+            size_t idx;
+            while((idx = next.fetch_add(1)) < all.size()){
+                valid[idx] = sketchBlob(readBlob(formatObjectId(all[idx]->blob)), sketches[idx]);
+            }
+        });
+    }
+    for(auto& t : pool) t.join();
+
+    const int rows = sketchSize / sketchBands;
+    auto bandKey = [&](const Sketch& sketch, int band){
+        uint64_t key = mixId(uint64_t(band) + 1);
+        for(int r = 0; r < rows; ++r) key = mixId(key ^ sketch[band * rows + r]);
+        return key;
+    };
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    for(size_t s = 0; s < sources.size(); ++s){
+        if(!valid[s]) continue;
+        for(int band = 0; band < sketchBands; ++band) buckets[bandKey(sketches[s], band)].push_back(s);
+    }
+
+    struct Candidate{ int score; uint32_t source; uint32_t target; };
+    std::vector<Candidate> candidates;
+    std::vector<size_t> seenBy(sources.size(), SIZE_MAX);
+    for(size_t t = 0; t < targets.size(); ++t){
+        const Sketch& sketch = sketches[sources.size() + t];
+        if(!valid[sources.size() + t]) continue;
+        for(int band = 0; band < sketchBands; ++band){
+            auto it = buckets.find(bandKey(sketch, band));
+            if(it == buckets.end()) continue;
+            for(uint32_t s : it->second){
+                if(seenBy[s] == t) continue;
+                seenBy[s] = t;
+                int score = 0;
+                for(int k = 0; k < sketchSize; ++k) score += sketches[s][k] == sketch[k];
+                if(score * 2 >= sketchSize) candidates.push_back({score, s, uint32_t(t)});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& x, const Candidate& y){
+        return x.score != y.score ? x.score > y.score : x.target < y.target;
+    });
+    std::vector<char> sourceUsed(sources.size(), 0), targetUsed(targets.size(), 0);
+    for(const auto& c : candidates){
+        if(sourceUsed[c.source] || targetUsed[c.target]) continue;
+        sourceUsed[c.source] = targetUsed[c.target] = 1;
+        renames.push_back({sources[c.source]->path, targets[c.target]->path, c.score * 100 / sketchSize, false});
+    }
+    return renames;
+}
+
+/*
+ Carry changes across renames before a three-way merge: when one side moved a file
+ the other side edited, the edit is also offered under the new path (with the old
+ base version as its base), so it merges into the moved file instead of being lost.
+ The old path leaves the other side too, otherwise the edit would read as a conflict
+ with the rename's deletion.
+*/
+std::vector<std::string> MiniGitRepo::followRenames(Snapshot& base, Snapshot& ours, Snapshot& theirs,
+                                                    const PathTable& paths) const{
+    std::vector<Rename> ourRenames = detectRenames(base, ours, paths);
+    std::vector<Rename> theirRenames = detectRenames(base, theirs, paths);
+    std::unordered_map<uint32_t, uint64_t> baseBlobs;
+    for(const auto& entry : base.entries) baseBlobs[entry.path] = entry.blob;
+
+    std::vector<std::string> notes;
+    std::unordered_set<uint32_t> moved;
+    auto carry = [&](const std::vector<Rename>& renames, Snapshot& other){
+        std::unordered_map<uint32_t, uint64_t> otherBlobs;
+        for(const auto& entry : other.entries) otherBlobs[entry.path] = entry.blob;
+        for(const auto& r : renames){
+            if(r.copy) continue;
+            auto edited = otherBlobs.find(r.from);
+            if(edited == otherBlobs.end() || otherBlobs.count(r.to) || edited->second == baseBlobs[r.from]) continue;
+            other.entries.push_back({r.to, edited->second});
+            base.entries.push_back({r.to, baseBlobs[r.from]});
+            moved.insert(r.from);
+            notes.push_back(std::string(paths.path(r.from)) + " -> " + std::string(paths.path(r.to)));
+        }
+    };
+    carry(ourRenames, theirs);
+    carry(theirRenames, ours);
+    for(Snapshot* snap : {&ours, &theirs}){
+        auto gone = std::remove_if(snap->entries.begin(), snap->entries.end(),
+                                   [&](const SnapshotEntry& entry){ return moved.count(entry.path) > 0; });
+        snap->entries.erase(gone, snap->entries.end());
+    }
+
+    auto byPath = [&](const SnapshotEntry& x, const SnapshotEntry& y){ return paths.path(x.path) < paths.path(y.path); };
+    for(Snapshot* snap : {&base, &ours, &theirs}) std::sort(snap->entries.begin(), snap->entries.end(), byPath);
+    return notes;
+}
+
+//write a commit object for snap through the journal; refs are left to the caller
+std::string MiniGitRepo::writeCommit(const std::string& message, const std::string& hashSeed, const std::string& parent,
+                                     const Snapshot& snap, PathTable& paths){
+    time_t now = time(0);
+    std::string hash = computeHash(hashSeed);
+
+    std::string author = commitAuthor();
+    std::vector<CommitEntry> entries;
+    entries.reserve(snap.entries.size());
+    for(const auto& entry : snap.entries){
+        entries.push_back({paths.path(entry.path), entry.blob});
+    }
+
+    fs::create_directories(baseDir + "/commits");
+    journalWrite(baseDir + "/commits/" + hash + ".txt", encodeCommit(message, author, now, parent, entries));
+    recordChangedPaths(hash, parent, snapshotChanges(loadTree(parent, paths), snap, paths));
+    recordLogTerms(hash, message, author);
+    return hash;
+}
+
+/*
+ HEAD, a branch name, a full commit hash, or a unique prefix of at least four hex
+ digits. Prefixes are answered from commits.idx, so resolving one never lists the
+ commits directory; a miss rebuilds the index once in case a commit arrived without it.
+*/
+Result<std::string> MiniGitRepo::resolveCommit(const std::string& name){
+    const size_t minAbbrev = 4;
+    Error unknown{ErrorCode::UnknownCommit, "unknown commit '" + name + "'."};
+    if(name.empty()) return unknown;
+    if(name == "HEAD"){
+        std::string head = headCommit();
+        if(head == "null") return unknown;
+        return head;
+    }
+    std::string refPath = refsDir + "/" + name;
+    if(fs::is_regular_file(refPath) || journalHas(refPath)){
+        std::string hash = readRef(refPath);
+        if(hash == "null" || hash.empty()) return unknown;
+        return hash;
+    }
+    std::string commitPath = baseDir + "/commits/" + name + ".txt";
+    if(fs::exists(commitPath) || journalHas(commitPath)) return name;
+    if(name.size() < minAbbrev) return unknown;
+
+    //every published commit is indexed by its writer, so a miss means there is no such commit
+    std::vector<std::string> matches = commitsWithPrefix(name, 8);
+    //the index may still list commits that prune has since removed
+    matches.erase(std::remove_if(matches.begin(), matches.end(), [&](const std::string& hash){
+        return !fs::exists(baseDir + "/commits/" + hash + ".txt");
+    }), matches.end());
+    if(matches.empty()) return unknown;
+    if(matches.size() > 1){
+        std::string candidates;
+        for(const auto& hash : matches) candidates += (candidates.empty() ? "" : ", ") + hash;
+        return Error{ErrorCode::AmbiguousCommit, "short hash '" + name + "' is ambiguous: " + candidates};
+    }
+    return matches.front();
+}
+
+static std::string findLCA(const std::string& commitsDir, const std::string& commit1, const std::string& commit2){
+    std::set<std::string> ancestors;
+    auto parentOf = [&](const std::string& hash){
+        MappedCommit commit;
+        return commit.open(commitsDir + "/" + hash + ".txt") ? commit.view().parent() : std::string("null");
+    };
+
+    //Traverse commit1 ancestors
+    for(std::string current = commit1; current != "null" && !current.empty(); current = parentOf(current)){
+        ancestors.insert(current);
+    }
+    //Traverse commit2 ancestors to find first common
+    for(std::string current = commit2; current != "null" && !current.empty(); current = parentOf(current)){
+        if(ancestors.count(current)) return current;
+    }
+
+    return "null";  //No common ancestor found
+}
+
+Result<MergeResult> MiniGitRepo::merge(const std::string& otherBranchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    //Load current branch from HEAD
+    std::string headRef = readRef(headFile);
+
+    std::string currentBranch = headRef.substr(5); //remove "ref: "
+    std::string currentBranchPath = baseDir + "/"  + currentBranch;
+    std::string otherBranchPath = refsDir + "/"  + otherBranchName;
+
+    //check if other branch exisits
+    if(!fs::exists(otherBranchPath) && !journalHas(otherBranchPath)){
+        return Error{ErrorCode::UnknownBranch, "Branch '" + otherBranchName + "' does not exist."};
+    }
+
+    std::string currentHash = readRef(currentBranchPath);
+    std::string otherHash = readRef(otherBranchPath);
+
+    if(otherHash == "null" || otherHash.empty()){
+        return Error{ErrorCode::NoCommits, "other branch has no commits."};
+    }
+    MergeResult result;
+    std::string lca = findLCA(baseDir + "/commits", currentHash, otherHash);
+    result.base = lca;
+
+    PathTable paths;
+    Snapshot lcaSnap = loadTree(lca, paths);
+    Snapshot curSnap = loadTree(currentHash, paths);
+    Snapshot othSnap = loadTree(otherHash, paths);
+    result.renames = followRenames(lcaSnap, curSnap, othSnap, paths);
+    TreeMerge merged = mergeSnapshots(lcaSnap, curSnap, othSnap, paths);
+    result.conflicts = merged.conflicts;
+
+    //create a new merged commit; conflicting files keep our side
+    time_t now= time(0);
+    std::string timestamp= ctime(&now);
+    std::string combined ="Merged with" + otherBranchName + timestamp;
+    result.commit = writeCommit("Merge with " + otherBranchName, combined, currentHash, merged.merged, paths);
+
+    //publish the merge commit and move the branch in one group flush
+    journalRef(baseDir + "/" + currentBranch, result.commit);
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+    return result;
+}
+
+//move every object of the legacy flat layout into its fan-out directory
+Result<MigrateReport> MiniGitRepo::migrateObjects(){
+    if(!fs::exists(objectsDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+
+    std::vector<std::string> flatObjects;
+    std::set<std::string> prefixes;
+    for(const auto& entry : fs::directory_iterator(objectsDir)){
+        if(!entry.is_regular_file()) continue;
+        std::string name = entry.path().filename().string();
+        if(name.size() < 2 || name.find_first_not_of("0123456789abcdef") != std::string::npos) continue;
+        flatObjects.push_back(name);
+        prefixes.insert(name.substr(0, 2));
+    }
+
+    MigrateReport report;
+    report.total = flatObjects.size();
+    if(flatObjects.empty()) return report;
+
+    //create the shard directories up front so workers only rename
+    for(const auto& prefix : prefixes){
+        fs::create_directories(objectsDir + "/" + prefix);
+    }
+
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> moved(0);
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < workers; ++i){
+        pool.emplace_back([&](){
+            size_t idx;
+            while((idx = next.fetch_add(1)) < flatObjects.size()){
+                const std::string& hash = flatObjects[idx];
+                std::error_code ec;
+                fs::rename(objectsDir + "/" + hash, objectPath(hash), ec);
+                if(!ec) ++moved;
+            }
+        });
+    }
+    for(auto& t : pool) t.join();
+    report.moved = moved;
+    return report;
+}
+
+//commit the current branch points at, "null" before the first commit
+std::string MiniGitRepo::headCommit() const{
+    std::string headRef = readRef(headFile);
+    if(headRef.rfind("ref: ", 0) != 0) return "null";
+    std::string hash = readRef(baseDir + "/" + headRef.substr(5));
+    return hash.empty() ? "null" : hash;
+}
+
+//staged paths, including an index update still waiting in the journal
+std::vector<std::string> MiniGitRepo::readIndex() const{
+    std::string text;
+    bool pending = false;
+    for(auto it = journalEntries.rbegin(); it != journalEntries.rend() && !pending; ++it){
+        if(it->isRef && it->path == indexFile){
+            text = it->content;
+            pending = true;
+        }
+    }
+    if(!pending){
+        std::ifstream file(indexFile);
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<std::string> staged;
+    std::istringstream in(text);
+    std::string line;
+    while(std::getline(in, line)){
+        if(!line.empty()) staged.push_back(line);
+    }
+    return staged;
+}
+
+static bool sameStat(const StatEntry& a, const StatEntry& b){
+    return a.mtimeNs == b.mtimeNs && a.size == b.size && a.inode == b.inode;
+}
+
+//the first line may carry the fsmonitor token the cache is current as of
+static std::unordered_map<std::string, StatEntry> loadStatCache(const std::string& file, std::string& token){
+    std::unordered_map<std::string, StatEntry> cache;
+    std::ifstream in(file);
+    std::string line;
+    token.clear();
+    while(std::getline(in, line)){
+        if(line.rfind("#fsmonitor ", 0) == 0){
+            token = line.substr(11);
+            continue;
+        }
+        std::stringstream fields(line);
+        std::string name;
+        StatEntry entry;
+        if(!std::getline(fields, name, '\t')) continue;
+        fields>> entry.mtimeNs>> entry.size>> entry.inode>> entry.hash;
+        cache[name] = entry;
+    }
+    return cache;
+}
+
+//entries modified within the last second are stored without a hash so a same-tick edit is never missed
+static void saveStatCache(const std::string& file, const std::map<std::string, StatEntry>& entries, const std::string& token){
+    int64_t racyCutoff = (int64_t(time(0)) - 1) * 1000000000LL;
+    std::stringstream out;
+    if(!token.empty()) out<< "#fsmonitor "<< token<< '\n';
+    for(const auto& [name, entry] : entries){
+        out<< name<< '\t'<< entry.mtimeNs<< ' '<< entry.size<< ' '<< entry.inode;
+        if(!entry.hash.empty() && entry.mtimeNs < racyCutoff) out<< ' '<< entry.hash;
+        out<< '\n';
+    }
+    if(writeWholeFile(file + ".tmp", out.str())){
+        fs::rename(file + ".tmp", file);
+    }
+}
+
+//PathMatcher. Each rule becomes a Thompson NFA fragment ending in an accepting state:
+//  literal, '?', '[...]'  one byte from a set ('?' and classes never match '/')
+//  '*'                    split looping over one non-'/' byte
+//  '**' at the end        split looping over any byte
+//  '**/'                  "" or anything ending in '/'
+//A rule without a '/' (other than a trailing one) may match at any depth, so it gets
+//an implicit leading "**/". DFA states are epsilon-closed sets of NFA states, created
+//the first time a byte leads to them; the last rule accepting at a state decides.
+bool PathMatcher::load(const std::string& file){
+    std::ifstream in(file);
+    if(!in) return false;
+    std::string line;
+    while(std::getline(in, line)) addRule(line);
+    return true;
+}
+
+void PathMatcher::addRule(const std::string& line){
+    std::string pattern = line;
+    if(!pattern.empty() && pattern.back() == '\r') pattern.pop_back();
+    while(!pattern.empty() && pattern.back() == ' ' && (pattern.size() < 2 || pattern[pattern.size() - 2] != '\\')){
+        pattern.pop_back();
+    }
+    if(pattern.empty() || pattern[0] == '#') return;
+
+    Rule rule{false, false};
+    if(pattern[0] == '!'){
+        rule.negate = true;
+        pattern.erase(0, 1);
+    }
+    if(!pattern.empty() && pattern.back() == '/'){
+        rule.dirOnly = true;
+        pattern.pop_back();
+    }
+    bool anchored = pattern.find('/') != std::string::npos;
+    if(!pattern.empty() && pattern[0] == '/') pattern.erase(0, 1);
+    if(pattern.empty()) return;
+    if(!anchored) pattern = "**/" + pattern;
+
+    //tokens of the pattern, built back to front so each state knows its successor
+    enum Kind{ Bytes, Star, AnyLoop, AnyDirs };
+    std::vector<std::pair<Kind, std::bitset<256>>> tokens;
+    std::bitset<256> notSlash;
+    notSlash.set();
+    notSlash.reset('/');
+    for(size_t i = 0; i < pattern.size(); ++i){
+        char c = pattern[i];
+        std::bitset<256> bytes;
+        if(c == '*' && i + 1 < pattern.size() && pattern[i + 1] == '*'){
+            if(i + 2 < pattern.size() && pattern[i + 2] == '/'){
+                tokens.push_back({AnyDirs, bytes});
+                i += 2;
+            }else if(i + 2 == pattern.size()){
+                tokens.push_back({AnyLoop, bytes});
+                ++i;
+            }else{
+                tokens.push_back({Star, bytes});
+                ++i;
+            }
+            continue;
+        }
+        if(c == '*'){
+            tokens.push_back({Star, bytes});
+            continue;
+        }
+        if(c == '?'){
+            tokens.push_back({Bytes, notSlash});
+            continue;
+        }
+        size_t close = c == '[' ? pattern.find(']', i + 2) : std::string::npos;
+        if(close != std::string::npos){
+            size_t j = i + 1;
+            bool invert = pattern[j] == '!' || pattern[j] == '^';
+            if(invert) ++j;
+            for(; j < close; ++j){
+                unsigned char lo = pattern[j], hi = lo;
+                if(j + 2 < close && pattern[j + 1] == '-'){
+                    hi = pattern[j + 2];
+                    j += 2;
+                }
+                for(unsigned b = lo; b <= hi; ++b) bytes.set(b);
+            }
+            if(invert) bytes.flip();
+            bytes.reset('/');
+            tokens.push_back({Bytes, bytes});
+            i = close;
+            continue;
+        }
+        if(c == '\\' && i + 1 < pattern.size()) c = pattern[++i];
+        bytes.set(static_cast<unsigned char>(c));
+        tokens.push_back({Bytes, bytes});
+    }
+
+    std::bitset<256> none, any;
+    any.set();
+    std::bitset<256> slash;
+    slash.set('/');
+    int cur = addNfaState(none, -1);
+    nfa[cur].rule = rules.size();
+    for(auto it = tokens.rbegin(); it != tokens.rend(); ++it){
+        if(it->first == Bytes){
+            cur = addNfaState(it->second, cur);
+        }else if(it->first == AnyDirs){
+            int slashState = addNfaState(slash, cur);
+            int loop = addNfaState(none, -1, slashState);
+            int anyByte = addNfaState(any, loop);
+            nfa[loop].next = anyByte;
+            cur = addNfaState(none, cur, loop);
+        }else{
+            int loop = addNfaState(none, -1, cur);
+            nfa[loop].next = addNfaState(it->first == Star ? notSlash : any, loop);
+            cur = loop;
+        }
+    }
+    rules.push_back(rule);
+    ruleStarts.push_back(cur);
+    dfa.clear();
+    dfaIds.clear();
+}
+
+int PathMatcher::addNfaState(const std::bitset<256>& bytes, int next, int alt){
+    NfaState state;
+    state.bytes = bytes;
+    state.next = next;
+    state.alt = alt;
+    nfa.push_back(state);
+    return nfa.size() - 1;
+}
+
+//add state and everything reachable from it over epsilon edges; splits themselves are left out
+void PathMatcher::closure(int state, std::vector<int>& out) const{
+    const NfaState& s = nfa[state];
+    if(s.bytes.none() && s.rule < 0){
+        if(s.next >= 0) closure(s.next, out);
+        if(s.alt >= 0) closure(s.alt, out);
+        return;
+    }
+    out.push_back(state);
+}
+
+int PathMatcher::dfaState(std::vector<int> states){
+    std::sort(states.begin(), states.end());
+    states.erase(std::unique(states.begin(), states.end()), states.end());
+    auto found = dfaIds.find(states);
+    if(found != dfaIds.end()) return found->second;
+
+    DfaState state;
+    state.next.fill(-1);
+    for(int s : states){
+        int rule = nfa[s].rule;
+        if(rule < 0) continue;
+        state.dirRule = std::max(state.dirRule, rule);
+        if(!rules[rule].dirOnly) state.fileRule = std::max(state.fileRule, rule);
+    }
+    state.nfa = states;
+    dfa.push_back(std::move(state));
+    dfaIds.emplace(std::move(states), dfa.size() - 1);
+    return dfa.size() - 1;
+}
+
+int PathMatcher::advance(int state, unsigned char c){
+    if(dfa.empty()){
+        std::vector<int> first;
+        for(int s : ruleStarts) closure(s, first);
+        dfaState(first);
+    }
+    int known = dfa[state].next[c];
+    if(known >= 0) return known;
+    std::vector<int> reached;
+    for(int s : dfa[state].nfa){
+        if(nfa[s].bytes.test(c)) closure(nfa[s].next, reached);
+    }
+    int target = dfaState(std::move(reached));
+    dfa[state].next[c] = target;
+    return target;
+}
+
+int PathMatcher::step(int state, std::string_view text){
+    std::lock_guard<std::mutex> guard(lock);
+    for(char c : text) state = advance(state, static_cast<unsigned char>(c));
+    return state;
+}
+
+bool PathMatcher::matches(int state, bool isDir){
+    std::lock_guard<std::mutex> guard(lock);
+    if(dfa.empty()) advance(start, 0);
+    int rule = isDir ? dfa[state].dirRule : dfa[state].fileRule;
+    return rule >= 0 && !rules[rule].negate;
+}
+
+bool PathMatcher::matches(std::string_view path, bool isDir){
+    return matches(step(start, path), isDir);
+}
+
+//does path match, or does one of its leading directories (a rule on a directory covers its contents)
+bool PathMatcher::matchesPathOrParent(std::string_view path, bool isDir){
+    int state = start;
+    size_t from = 0;
+    for(size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)){
+        state = step(state, path.substr(from, slash - from));
+        if(matches(state, true)) return true;
+        state = step(state, "/");
+        from = slash + 1;
+    }
+    return matches(step(state, path.substr(from)), isDir);
+}
+
+//a directory with its own repository entry is a linked worktree or another repository
+//nested in this working tree; none of its files belong to this one
+static bool holdsRepository(const std::string& dir, const std::string& repoEntry){
+    struct stat st;
+    return ::lstat((dir + "/" + repoEntry).c_str(), &st) == 0;
+}
+
+/*
+ Parallel working-tree walk: workers pop directories from a shared queue, push
+ subdirectories back and lstat the regular files they find. The walk is done
+ when the queue is empty and no worker is still reading a directory. Directories
+ holding their own skipDir entry (nested worktrees) are not entered.
+*/
+static std::map<std::string, StatEntry> walkWorkingTree(const std::string& skipDir, const std::string& root,
+                                                  PathMatcher* ignore){
+    std::mutex lock;
+    std::condition_variable wake;
+    //each directory travels with the ignore-matcher state reached after "<dir>/"
+    int rootState = PathMatcher::start;
+    if(ignore && root != ".") rootState = ignore->step(rootState, root + "/");
+    std::vector<std::pair<std::string, int>> queue{{root, rootState}};
+    size_t busy = 0;
+    std::map<std::string, StatEntry> files;
+
+    auto worker = [&](){
+        std::map<std::string, StatEntry> local;
+        std::unique_lock<std::mutex> guard(lock);
+        while(true){
+            wake.wait(guard, [&]{ return !queue.empty() || busy == 0; });
+            if(queue.empty()) break;
+            auto [dir, dirState] = queue.back();
+            queue.pop_back();
+            ++busy;
+            guard.unlock();
+
+            std::vector<std::pair<std::string, int>> subdirs;
+            if(DIR* d = ::opendir(dir.c_str())){
+                while(dirent* ent = ::readdir(d)){
+                    std::string name = ent->d_name;
+                    if(name == "." || name == "..") continue;
+                    std::string full = dir == "." ? name : dir + "/" + name;
+                    if(full == skipDir) continue;
+                    struct stat st;
+                    if(::lstat(full.c_str(), &st) != 0) continue;
+                    bool isDir = S_ISDIR(st.st_mode);
+                    int state = PathMatcher::start;
+                    if(ignore){
+                        //an ignored directory is never opened, so nothing below it is seen
+                        state = ignore->step(dirState, name);
+                        if(ignore->matches(state, isDir)) continue;
+                    }
+                    if(isDir){
+                        if(holdsRepository(full, skipDir)) continue;
+                        subdirs.push_back({full, ignore ? ignore->step(state, "/") : state});
+                    }else if(S_ISREG(st.st_mode)){
+                        StatEntry entry;
+                        entry.mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+                        entry.size = st.st_size;
+                        entry.inode = st.st_ino;
+                        local[full] = entry;
+                    }
+                }
+                ::closedir(d);
+            }
+
+            guard.lock();
+            --busy;
+            queue.insert(queue.end(), subdirs.begin(), subdirs.end());
+            wake.notify_all();
+        }
+        files.insert(local.begin(), local.end());
+        wake.notify_all();
+    };
+
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < workers; ++i) pool.emplace_back(worker);
+    for(auto& t : pool) t.join();
+    return files;
+}
+
+//hash the given files on a worker per core
+static void hashInParallel(std::map<std::string, StatEntry>& files, const std::vector<std::string>& names){
+    std::atomic<size_t> next(0);
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < workers; ++i){
+        pool.emplace_back([&](){
+            size_t idx;
+            while((idx = next.fetch_add(1)) < names.size()){
+                files.find(names[idx])->second.hash = hashWorkingFile(names[idx]);
+            }
+        });
+    }
+    for(auto& t : pool) t.join();
+}
+
+//bring a single path reported by the fsmonitor up to date in the scan result
+static void refreshScannedPath(std::map<std::string, StatEntry>& work, const std::string& path, const std::string& skipDir,
+                        PathMatcher& ignore){
+    if(path == skipDir || path.rfind(skipDir + "/", 0) == 0) return;
+
+    //whatever was known at or below path is stale now
+    auto it = work.lower_bound(path);
+    while(it != work.end() && (it->first == path || it->first.rfind(path + "/", 0) == 0)){
+        it = work.erase(it);
+    }
+
+    //nothing inside a nested worktree is ours, the path itself included once it holds one
+    for(size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)){
+        if(holdsRepository(path.substr(0, slash), skipDir)) return;
+    }
+
+    struct stat st;
+    if(::lstat(path.c_str(), &st) != 0) return;
+    if(ignore.matchesPathOrParent(path, S_ISDIR(st.st_mode))) return;
+    if(S_ISDIR(st.st_mode)){
+        if(holdsRepository(path, skipDir)) return;
+        std::map<std::string, StatEntry> subtree = walkWorkingTree(skipDir, path, &ignore);
+        work.insert(subtree.begin(), subtree.end());
+    }else if(S_ISREG(st.st_mode)){
+        StatEntry entry;
+        entry.mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        entry.size = st.st_size;
+        entry.inode = st.st_ino;
+        work[path] = entry;
+    }
+}
+
+/*
+ Stat every working file (or, with a running fsmonitor, only the paths it reported
+ since the cache was written) and hash only tracked files whose stat data changed.
+ Ignored subtrees are not walked; tracked files inside them are stat'ed one by one.
+ With deferredToken the changed files are left without a hash and the cache is not
+ written: the caller hashes them itself and saves the cache with that token.
+*/
+std::map<std::string, StatEntry> MiniGitRepo::scanWorkingTree(const std::set<std::string>& tracked,
+                                                              std::string* deferredToken){
+    std::string cacheToken;
+    std::unordered_map<std::string, StatEntry> cache = loadStatCache(statCacheFile, cacheToken);
+
+    //take the new token before looking at the tree so nothing changing during the scan is lost
+    std::string newToken = fsmonitorToken();
+    std::set<std::string> changed;
+    std::map<std::string, StatEntry> work;
+    PathMatcher ignore;
+    ignore.load(ignoreFile);
+    if(!newToken.empty() && !cacheToken.empty() && fsmonitorChanges(cacheToken, changed)){
+        work.insert(cache.begin(), cache.end());
+        for(const auto& path : changed) refreshScannedPath(work, path, workTreeEntry, ignore);
+    }else{
+        work = walkWorkingTree(workTreeEntry, ".", &ignore);
+    }
+    for(const auto& name : tracked){
+        struct stat st;
+        if(work.count(name) || ::lstat(name.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        StatEntry entry;
+        entry.mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        entry.size = st.st_size;
+        entry.inode = st.st_ino;
+        work[name] = entry;
+    }
+
+    std::vector<std::string> toHash;
+    for(auto& [name, entry] : work){
+        if(!tracked.count(name)) continue;
+        auto cached = cache.find(name);
+        if(cached != cache.end() && sameStat(cached->second, entry) && !cached->second.hash.empty()){
+            entry.hash = cached->second.hash;
+        }else{
+            toHash.push_back(name);
+        }
+    }
+    if(deferredToken){
+        *deferredToken = newToken;
+        return work;
+    }
+    hashInParallel(work, toHash);
+    saveStatCache(statCacheFile, work, newToken);
+    return work;
+}
+
+Result<StatusReport> MiniGitRepo::status(){
+    if(!fs::exists(baseDir)) return notARepository();
+
+    //a legacy HEAD lists only what it staged, so compare against the whole tree it resolves to
+    std::string head = headCommit();
+    std::map<std::string, std::string> headFiles = loadTreeFiles(head);
+    std::vector<std::string> staged = readIndex();
+
+    //outside the sparse-checkout patterns committed files are expected to be absent
+    PathMatcher sparse;
+    bool isSparse = loadSparse(sparse);
+    for(auto it = headFiles.begin(); isSparse && it != headFiles.end();){
+        it = sparse.matchesPathOrParent(it->first, false) ? std::next(it) : headFiles.erase(it);
+    }
+    std::set<std::string> stagedSet(staged.begin(), staged.end());
+
+    std::set<std::string> tracked = stagedSet;
+    for(const auto& entry : headFiles) tracked.insert(entry.first);
+    std::map<std::string, StatEntry> work = scanWorkingTree(tracked);
+
+    StatusReport report;
+    report.head = head;
+
+    for(const auto& name : staged){
+        FileState state = !work.count(name) ? FileState::Deleted :
+                          !headFiles.count(name) ? FileState::New :
+                          headFiles[name] != work[name].hash ? FileState::Modified : FileState::Unchanged;
+        report.staged.push_back({name, state});
+    }
+
+    for(const auto& [name, blob] : headFiles){
+        if(stagedSet.count(name)) continue;
+        auto it = work.find(name);
+        if(it == work.end()) report.unstaged.push_back({name, FileState::Deleted});
+        else if(it->second.hash != blob) report.unstaged.push_back({name, FileState::Modified});
+    }
+
+    for(const auto& entry : work){
+        if(isSparse && !sparse.matchesPathOrParent(entry.first, false)) continue;
+        if(!headFiles.count(entry.first) && !stagedSet.count(entry.first)){
+            report.untracked.push_back(entry.first);
+        }
+    }
+    return report;
+}
+
+/*
+ fsmonitor: a background process watches the working tree with inotify and appends
+ every changed path to fsmonitor.log. A token is "<daemon id>:<log offset>"; the
+ paths logged after a token are exactly what changed since it was taken. A "*" line
+ (event queue overflow) or a different daemon id forces a full scan.
+*/
+std::string MiniGitRepo::fsmonitorToken() const{
+    std::ifstream pidIn(fsmonitorPidFile);
+    pid_t pid = 0;
+    std::string id;
+    if(!(pidIn>> pid>> id) || ::kill(pid, 0) != 0) return "";
+    std::error_code ec;
+    uintmax_t size = fs::file_size(fsmonitorLogFile, ec);
+    if(ec) return "";
+    return id + ":" + std::to_string(size);
+}
+
+bool MiniGitRepo::fsmonitorChanges(const std::string& since, std::set<std::string>& changed) const{
+    std::string current = fsmonitorToken();
+    size_t colon = since.rfind(':');
+    if(current.empty() || colon == std::string::npos) return false;
+    if(current.substr(0, current.rfind(':')) != since.substr(0, colon)) return false;
+
+    std::ifstream logIn(fsmonitorLogFile);
+    logIn.seekg(std::stoull(since.substr(colon + 1)));
+    std::string line;
+    while(std::getline(logIn, line)){
+        if(line == "*") return false;
+        if(!line.empty()) changed.insert(line);
+    }
+    return true;
+}
+
+//add a watch for dir and every directory below it (the repository directory and nested worktrees excluded)
+static bool watchTree(int fd, const std::string& dir, const std::string& skipDir, std::unordered_map<int, std::string>& watches){
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM |
+                          IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_ONLYDIR;
+    int wd = ::inotify_add_watch(fd, dir.c_str(), mask);
+    if(wd < 0) return false;
+    watches[wd] = dir;
+
+    DIR* d = ::opendir(dir.c_str());
+    if(!d) return true;
+    bool ok = true;
+    while(dirent* ent = ::readdir(d)){
+        std::string name = ent->d_name;
+        if(name == "." || name == "..") continue;
+        std::string full = dir == "." ? name : dir + "/" + name;
+        if(full == skipDir) continue;
+        struct stat st;
+        if(::lstat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && !holdsRepository(full, skipDir)){
+            ok = watchTree(fd, full, skipDir, watches) && ok;
+        }
+    }
+    ::closedir(d);
+    return ok;
+}
+
+void MiniGitRepo::runFsmonitor(){
+    const uintmax_t maxLogSize = 8 << 20;
+    int fd = ::inotify_init1(IN_CLOEXEC);
+    if(fd < 0) return;
+
+    //a new id on every (re)start invalidates tokens handed out by an earlier daemon
+    auto startGeneration = [&](){
+        std::string id = std::to_string(::getpid()) + "-" + std::to_string(time(0));
+        writeWholeFile(fsmonitorLogFile, "");
+        writeWholeFile(fsmonitorPidFile + ".tmp", std::to_string(::getpid()) + " " + id + "\n");
+        fs::rename(fsmonitorPidFile + ".tmp", fsmonitorPidFile);
+    };
+
+    std::unordered_map<int, std::string> watches;
+    if(!watchTree(fd, ".", workTreeEntry, watches)){
+        //out of inotify watches: a partial view would hide changes, so don't run at all
+        ::close(fd);
+        return;
+    }
+    startGeneration();
+
+    int logFd = ::open(fsmonitorLogFile.c_str(), O_WRONLY | O_APPEND);
+    alignas(inotify_event) char buf[64 * 1024];
+    while(true){
+        ssize_t len = ::read(fd, buf, sizeof(buf));
+        if(len <= 0) break;
+        if(!fs::exists(baseDir)) break;
+
+        std::string batch;
+        for(char* p = buf; p < buf + len; ){
+            inotify_event* ev = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if(ev->mask & IN_Q_OVERFLOW){
+                batch += "*\n";
+                continue;
+            }
+            auto dir = watches.find(ev->wd);
+            if(dir == watches.end()) continue;
+            if(ev->mask & (IN_DELETE_SELF | IN_IGNORED)){
+                watches.erase(dir);
+                continue;
+            }
+            if(ev->len == 0) continue;
+            std::string full = dir->second == "." ? std::string(ev->name) : dir->second + "/" + ev->name;
+            if(full == workTreeEntry) continue; //the repository itself, or a linked worktree's link file
+            if((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))){
+                if(!watchTree(fd, full, workTreeEntry, watches)) batch += "*\n";
+            }
+            batch += full + "\n";
+        }
+        if(!batch.empty()){
+            if(::write(logFd, batch.data(), batch.size()) < 0) break;
+        }
+
+        std::error_code ec;
+        if(fs::file_size(fsmonitorLogFile, ec) > maxLogSize){
+            ::close(logFd);
+            startGeneration();
+            logFd = ::open(fsmonitorLogFile.c_str(), O_WRONLY | O_APPEND);
+        }
+    }
+    ::close(logFd);
+    ::close(fd);
+}
+
+Result<FsmonitorState> MiniGitRepo::fsmonitor(const std::string& action){
+    if(!fs::exists(baseDir)) return notARepository();
+
+    FsmonitorState state;
+    state.token = fsmonitorToken();
+    state.running = !state.token.empty();
+    if(action == "start"){
+        if(state.running) return Error{ErrorCode::AlreadyExists, "fsmonitor is already running."};
+        std::cout.flush();
+        pid_t pid = ::fork();
+        if(pid < 0){
+            return Error{ErrorCode::SystemError, std::string("could not start fsmonitor: ") + std::strerror(errno)};
+        }
+        if(pid == 0){
+            ::setsid();
+            int devNull = ::open("/dev/null", O_RDWR);
+            ::dup2(devNull, 0);
+            ::dup2(devNull, 1);
+            ::dup2(devNull, 2);
+            runFsmonitor();
+            ::_exit(0);
+        }
+        state.running = true;
+        state.pid = pid;
+    }
+    else if(action == "stop"){
+        std::ifstream pidIn(fsmonitorPidFile);
+        pid_t pid = 0;
+        if(!state.running || !(pidIn>> pid)) return Error{ErrorCode::NotFound, "fsmonitor is not running."};
+        ::kill(pid, SIGTERM);
+        fs::remove(fsmonitorPidFile);
+        fs::remove(fsmonitorLogFile);
+        state.running = false;
+        state.pid = pid;
+        state.token.clear();
+    }
+    return state;
+}
+
+std::string MiniGitRepo::commitParent(const std::string& hash) const{
+    MappedCommit commit;
+    return readCommit(hash, commit) ? commit.view().parent() : "null";
+}
+
+//every branch under refs/, name -> commit hash
+std::map<std::string, std::string> MiniGitRepo::listRefs() const{
+    std::map<std::string, std::string> refs;
+    if(!fs::exists(refsDir)) return refs;
+    for(const auto& entry : fs::recursive_directory_iterator(refsDir)){
+        if(!entry.is_regular_file()) continue;
+        std::string name = fs::relative(entry.path(), refsDir).string();
+        if(name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) continue;
+        refs[name] = readRef(entry.path().string());
+    }
+    return refs;
+}
+
+//object ids a blob keeps alive: itself, plus its chunks when it is a chunk list
+std::vector<uint64_t> MiniGitRepo::blobObjects(uint64_t blob) const{
+    std::vector<uint64_t> ids{blob};
+    std::ifstream in(findObject(formatObjectId(blob)), std::ios::binary);
+    std::string header(chunkListHeader.size(), '\0');
+    if(!in.read(&header[0], header.size()) || header != chunkListHeader) return ids;
+    std::string chunkHash;
+    size_t size;
+    uint64_t id;
+    while(in>> chunkHash>> size){
+        if(parseObjectId(chunkHash, id)) ids.push_back(id);
+    }
+    return ids;
+}
+
+/*
+ Reachability bitmaps. bitmap-ids numbers every object and commit id the first
+ time a prune sees it (append only, so positions never move). bitmaps stores, per
+ commit, the set of positions reachable from it:
+   u64 commit id, u64 word count, words
+ A later walk that reaches a commit with a stored bitmap ORs it in and stops.
+*/
+namespace{
+
+struct Bitmap{
+    std::vector<uint64_t> words;
+
+    void set(size_t pos){
+        if(words.size() <= pos / 64) words.resize(pos / 64 + 1, 0);
+        words[pos / 64] |= 1ULL << (pos % 64);
+    }
+    bool test(size_t pos) const{
+        return pos / 64 < words.size() && (words[pos / 64] >> (pos % 64)) & 1;
+    }
+    void merge(const Bitmap& other){
+        if(words.size() < other.words.size()) words.resize(other.words.size(), 0);
+        for(size_t i = 0; i < other.words.size(); ++i) words[i] |= other.words[i];
+    }
+    size_t count() const{
+        size_t n = 0;
+        for(uint64_t w : words) n += __builtin_popcountll(w);
+        return n;
+    }
+};
+
+} //namespace
+
+static std::unordered_map<uint64_t, Bitmap> loadBitmaps(const std::string& file){
+    std::unordered_map<uint64_t, Bitmap> bitmaps;
+    std::ifstream in(file, std::ios::binary);
+    uint64_t id, size;
+    while(in.read(reinterpret_cast<char*>(&id), 8) && in.read(reinterpret_cast<char*>(&size), 8)){
+        Bitmap bm;
+        bm.words.resize(size);
+        if(size > 0 && !in.read(reinterpret_cast<char*>(bm.words.data()), size * 8)) break;
+        bitmaps[id] = std::move(bm);
+    }
+    return bitmaps;
+}
+
+Result<PruneReport> MiniGitRepo::prune(long long expireSeconds){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    flushJournal();
+
+    //number every object and commit, keeping the positions handed out by earlier prunes
+    std::vector<uint64_t> positions;
+    std::unordered_map<uint64_t, size_t> positionOf;
+    {
+        std::ifstream in(bitmapIdsFile, std::ios::binary);
+        uint64_t id;
+        while(in.read(reinterpret_cast<char*>(&id), 8)){
+            positionOf.emplace(id, positions.size());
+            positions.push_back(id);
+        }
+    }
+    rebuildObjectIndex();
+    std::vector<uint64_t> objects = objectIndex.allIds();
+    std::vector<uint64_t> commits;
+    if(fs::exists(baseDir + "/commits")){
+        for(const auto& entry : fs::directory_iterator(baseDir + "/commits")){
+            uint64_t id;
+            if(entry.path().extension() == ".txt" && parseObjectId(entry.path().stem().string(), id)) commits.push_back(id);
+        }
+    }
+    std::string newIds;
+    for(const auto* list : {&objects, &commits}){
+        for(uint64_t id : *list){
+            if(positionOf.emplace(id, positions.size()).second){
+                positions.push_back(id);
+                newIds.append(reinterpret_cast<const char*>(&id), 8);
+            }
+        }
+    }
+    std::ofstream idsOut(bitmapIdsFile, std::ios::binary | std::ios::app);
+    idsOut.write(newIds.data(), newIds.size());
+    idsOut.close();
+
+    std::unordered_map<uint64_t, Bitmap> cached = loadBitmaps(bitmapsFile);
+
+    //roots: every branch tip, plus whatever is staged right now
+    std::map<std::string, std::string> refs = listRefs();
+    std::vector<std::string> roots;
+    for(const auto& ref : refs){
+        if(ref.second != "null" && !ref.second.empty()) roots.push_back(ref.second);
+    }
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+    Bitmap reachable;
+    for(const auto& staged : stagedInAllWorktrees()){
+        uint64_t blob;
+        if(fs::exists(staged) && parseObjectId(hashWorkingFile(staged), blob)){
+            for(uint64_t id : blobObjects(blob)){
+                auto pos = positionOf.find(id);
+                if(pos != positionOf.end()) reachable.set(pos->second);
+            }
+        }
+    }
+
+    //one marker per root; a commit already claimed by another marker ends the walk, since
+    //first-parent history below it is covered by whoever claimed it
+    std::mutex visitedLock;
+    std::set<uint64_t> visited;
+    std::vector<Bitmap> rootBitmaps(roots.size());
+    std::vector<char> complete(roots.size(), 1);
+    std::atomic<size_t> next(0);
+    auto marker = [&](){
+        size_t r;
+        while((r = next.fetch_add(1)) < roots.size()){
+            Bitmap& bm = rootBitmaps[r];
+            std::string hash = roots[r];
+            std::set<uint64_t> seenBlobs;
+            while(hash != "null" && !hash.empty()){
+                uint64_t id;
+                if(!parseObjectId(hash, id)) break;
+                auto hit = cached.find(id);
+                if(hit != cached.end()){
+                    bm.merge(hit->second);
+                    break;
+                }
+                {
+                    std::lock_guard<std::mutex> guard(visitedLock);
+                    if(!visited.insert(id).second){
+                        complete[r] = 0; //partial, so not worth keeping as a bitmap
+                        break;
+                    }
+                }
+                if(!fs::exists(baseDir + "/commits/" + hash + ".txt")) break;
+                auto pos = positionOf.find(id);
+                if(pos != positionOf.end()) bm.set(pos->second);
+
+                PathTable paths;
+                Snapshot snap = loadSnapshot(hash, paths);
+                for(const auto& entry : snap.entries){
+                    if(!seenBlobs.insert(entry.blob).second) continue;
+                    for(uint64_t obj : blobObjects(entry.blob)){
+                        auto objPos = positionOf.find(obj);
+                        if(objPos != positionOf.end()) bm.set(objPos->second);
+                    }
+                }
+                hash = commitParent(hash);
+            }
+        }
+    };
+    unsigned workers = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), roots.size()));
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < workers; ++i) pool.emplace_back(marker);
+    for(auto& t : pool) t.join();
+
+    //roots that stopped at a commit claimed by another root share that root's history
+    for(auto& bm : rootBitmaps) reachable.merge(bm);
+    for(size_t r = 0; r < roots.size(); ++r){
+        uint64_t id;
+        if(complete[r] && parseObjectId(roots[r], id)) cached[id] = rootBitmaps[r];
+    }
+    const Bitmap& all = reachable;
+
+    //delete what is unreachable and older than the grace period
+    fs::file_time_type cutoff = fs::file_time_type::clock::now() - std::chrono::seconds(expireSeconds);
+    size_t pruned = 0, kept = 0, unreachable = 0;
+    for(size_t pos = 0; pos < positions.size(); ++pos){
+        if(all.test(pos)) continue;
+        std::string hash = formatObjectId(positions[pos]);
+        std::string path = findObject(hash);
+        if(path.empty()){
+            std::string commitPath = baseDir + "/commits/" + hash + ".txt";
+            if(!fs::exists(commitPath)) continue;
+            path = commitPath;
+        }
+        ++unreachable;
+        std::error_code ec;
+        if(fs::last_write_time(path, ec) > cutoff || ec){
+            ++kept;
+            continue;
+        }
+        fs::remove(path);
+        ++pruned;
+    }
+    if(pruned > 0){
+        rebuildObjectIndex();
+        rebuildCommitIndex();
+    }
+
+    //keep bitmaps only for commits that are still reachable, the tips of this run included
+    std::string out;
+    for(const auto& [id, bm] : cached){
+        auto pos = positionOf.find(id);
+        if(pos == positionOf.end() || !all.test(pos->second)) continue;
+        uint64_t size = bm.words.size();
+        out.append(reinterpret_cast<const char*>(&id), 8);
+        out.append(reinterpret_cast<const char*>(&size), 8);
+        out.append(reinterpret_cast<const char*>(bm.words.data()), size * 8);
+    }
+    if(writeWholeFile(bitmapsFile + ".tmp", out)){
+        fs::rename(bitmapsFile + ".tmp", bitmapsFile);
+    }
+
+    PruneReport report;
+    report.reachable = all.count();
+    report.unreachable = unreachable;
+    report.kept = kept;
+    report.pruned = pruned;
+    return report;
+}
+
+/*
+ fsck: every object and commit file is read and checked on a pool of workers
+ (twice the core count, so reads overlap hashing). Objects must hash to their
+ name; commits must have a resolvable parent and file entries. Afterwards the
+ collected references give the dangling objects and commits.
+*/
+Result<FsckReport> MiniGitRepo::fsck(){
+    if(!fs::exists(baseDir)) return notARepository();
+    flushJournal();
+
+    std::vector<std::pair<uint64_t, std::string>> objects; //id, path
+    std::unordered_map<uint64_t, size_t> objectSlot;
+    for(const auto& entry : fs::recursive_directory_iterator(objectsDir)){
+        uint64_t id;
+        if(entry.is_regular_file() && parseObjectId(entry.path().filename().string(), id)){
+            objectSlot.emplace(id, objects.size());
+            objects.push_back({id, entry.path().string()});
+        }
+    }
+    std::vector<std::string> commits;
+    std::set<std::string> commitSet;
+    if(fs::exists(baseDir + "/commits")){
+        for(const auto& entry : fs::directory_iterator(baseDir + "/commits")){
+            if(entry.path().extension() != ".txt") continue;
+            commits.push_back(entry.path().stem().string());
+            commitSet.insert(commits.back());
+        }
+    }
+
+    std::mutex reportLock;
+    std::vector<std::string> problems;
+    std::set<uint64_t> referenced;
+    std::map<std::string, std::string> parents;
+    auto report = [&](const std::string& line){
+        std::lock_guard<std::mutex> guard(reportLock);
+        problems.push_back(line);
+    };
+
+    std::atomic<size_t> next(0);
+    size_t total = objects.size() + commits.size();
+    auto worker = [&](){
+        std::set<uint64_t> localRefs;
+        std::map<std::string, std::string> localParents;
+        size_t idx;
+        while((idx = next.fetch_add(1)) < total){
+            if(idx < objects.size()){
+                const auto& [id, path] = objects[idx];
+                std::ifstream in(path, std::ios::binary);
+                std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                std::string name = formatObjectId(id);
+                if(computeHash(content) != name){
+                    report("corrupt object " + name);
+                    continue;
+                }
+                if(!isChunkList(content)) continue;
+                std::stringstream list(content.substr(chunkListHeader.size()));
+                std::string chunkHash;
+                size_t size;
+                uint64_t chunk;
+                while(list>> chunkHash>> size){
+                    if(!parseObjectId(chunkHash, chunk) || !objectSlot.count(chunk)){
+                        report("missing chunk " + chunkHash + " of blob " + name);
+                    }else{
+                        localRefs.insert(chunk);
+                    }
+                }
+                continue;
+            }
+
+            const std::string& hash = commits[idx - objects.size()];
+            MappedCommit commit;
+            if(!commit.open(baseDir + "/commits/" + hash + ".txt")){
+                report("corrupt commit " + hash);
+                continue;
+            }
+            std::string parent = commit.view().parent();
+            localParents[hash] = parent;
+            if(parent != "null" && !commitSet.count(parent)){
+                report("missing parent " + parent + " of commit " + hash);
+            }
+            PathTable paths;
+            Snapshot snap = snapshotOf(commit.view(), paths);
+            for(const auto& entry : snap.entries){
+                if(!objectSlot.count(entry.blob)){
+                    report("missing blob " + formatObjectId(entry.blob) + " for " +
+                           std::string(paths.path(entry.path)) + " in commit " + hash);
+                }
+                localRefs.insert(entry.blob);
+            }
+        }
+        std::lock_guard<std::mutex> guard(reportLock);
+        referenced.insert(localRefs.begin(), localRefs.end());
+        parents.insert(localParents.begin(), localParents.end());
+    };
+    unsigned workers = std::max(2u, 2 * std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < workers; ++i) pool.emplace_back(worker);
+    for(auto& t : pool) t.join();
+
+    //refs must resolve; commits no ref reaches and objects nothing names are dangling
+    std::set<std::string> reachable;
+    for(const auto& [name, hash] : listRefs()){
+        if(hash == "null" || hash.empty()) continue;
+        if(!commitSet.count(hash)){
+            problems.push_back("branch " + name + " points to missing commit " + hash);
+            continue;
+        }
+        for(std::string c = hash; c != "null" && commitSet.count(c) && reachable.insert(c).second; c = parents[c]){}
+    }
+    for(const auto& staged : stagedInAllWorktrees()){
+        uint64_t blob;
+        if(fs::exists(staged) && parseObjectId(hashWorkingFile(staged), blob)) referenced.insert(blob);
+    }
+
+    FsckReport result;
+    result.objects = objects.size();
+    result.commits = commits.size();
+    std::sort(problems.begin(), problems.end());
+    result.problems = std::move(problems);
+    for(const auto& hash : commits){
+        if(!reachable.count(hash)) result.danglingCommits.push_back(hash);
+    }
+    for(const auto& object : objects){
+        if(!referenced.count(object.first)) result.danglingObjects.push_back(formatObjectId(object.first));
+    }
+    return result;
+}
+
+/*
+ Pack protocol between a fetching repository and an upload-pack server, spoken over
+ a pair of pipes (the server is a forked child working in the source repository):
+   server: "ref <name> <hash>" lines, "head <branch>", "end"
+   client: "want <hash>" lines, "have <hash>" lines, "done"
+   server: "pack <commits> <objects>", then per record "commit|object <hash> <size>"
+           followed by that many bytes; commits come oldest first
+ The server walks each want back to the first commit the client has and sends only
+ those commits and the objects they use that the common commits don't already use.
+*/
+static bool readLine(FILE* in, std::string& line){
+    line.clear();
+    int c;
+    while((c = std::fgetc(in)) != EOF && c != '\n') line += static_cast<char>(c);
+    return c != EOF || !line.empty();
+}
+
+void MiniGitRepo::serveUploadPack(FILE* in, FILE* out){
+    std::map<std::string, std::string> refs = listRefs();
+    for(const auto& [name, hash] : refs){
+        std::fprintf(out, "ref %s %s\n", name.c_str(), hash.c_str());
+    }
+    std::string headRef = readRef(headFile);
+    std::fprintf(out, "head %s\nend\n", headRef.size() > 10 ? headRef.substr(10).c_str() : "main");
+    std::fflush(out);
+
+    std::vector<std::string> wants;
+    std::set<std::string> haves;
+    std::string line;
+    while(readLine(in, line) && line != "done"){
+        if(line.rfind("want ", 0) == 0) wants.push_back(line.substr(5));
+        else if(line.rfind("have ", 0) == 0 && fs::exists(baseDir + "/commits/" + line.substr(5) + ".txt")){
+            haves.insert(line.substr(5));
+        }
+    }
+
+    //missing commits: everything from a want down to the first commit the client has
+    std::vector<std::string> sendCommits;
+    std::set<std::string> queued;
+    std::set<std::string> common;
+    for(const auto& want : wants){
+        std::vector<std::string> chain;
+        for(std::string c = want; c != "null" && !c.empty() && !queued.count(c); c = commitParent(c)){
+            if(haves.count(c)){
+                common.insert(c);
+                break;
+            }
+            if(!fs::exists(baseDir + "/commits/" + c + ".txt")) break;
+            chain.push_back(c);
+            queued.insert(c);
+        }
+        sendCommits.insert(sendCommits.end(), chain.rbegin(), chain.rend());
+    }
+
+    std::set<uint64_t> known;
+    for(const auto& c : common){
+        PathTable paths;
+        for(const auto& entry : loadSnapshot(c, paths).entries){
+            for(uint64_t id : blobObjects(entry.blob)) known.insert(id);
+        }
+    }
+    std::vector<uint64_t> sendObjects;
+    for(const auto& c : sendCommits){
+        PathTable paths;
+        for(const auto& entry : loadSnapshot(c, paths).entries){
+            if(known.count(entry.blob)) continue;
+            for(uint64_t id : blobObjects(entry.blob)){
+                if(known.insert(id).second) sendObjects.push_back(id);
+            }
+        }
+    }
+
+    auto sendFile = [&](const char* kind, const std::string& hash, const std::string& path){
+        std::ifstream file(path, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::fprintf(out, "%s %s %zu\n", kind, hash.c_str(), data.size());
+        std::fwrite(data.data(), 1, data.size(), out);
+    };
+    std::fprintf(out, "pack %zu %zu\n", sendCommits.size(), sendObjects.size());
+    for(uint64_t id : sendObjects){
+        std::string hash = formatObjectId(id);
+        sendFile("object", hash, findObject(hash));
+    }
+    for(const auto& c : sendCommits){
+        sendFile("commit", c, baseDir + "/commits/" + c + ".txt");
+    }
+    std::fflush(out);
+}
+
+//fetch wantBranch (every branch when empty) from the repository at source into the journal
+Error MiniGitRepo::fetchPack(const std::string& source, const std::string& wantBranch,
+                             std::map<std::string, std::string>& remoteRefs, std::string& remoteHead,
+                             std::map<std::string, std::string>& packParents, FetchResult& stats){
+    if(!fs::exists(fs::path(source) / ".minigit")){
+        return Error{ErrorCode::NotARepository, "'" + source + "' is not a MiniGit repository."};
+    }
+
+    int toServer[2], fromServer[2];
+    if(::pipe(toServer) != 0 || ::pipe(fromServer) != 0){
+        return Error{ErrorCode::SystemError, std::string("could not open pipes: ") + std::strerror(errno)};
+    }
+    std::cout.flush();
+    pid_t pid = ::fork();
+    if(pid < 0) return Error{ErrorCode::SystemError, std::string("could not start the server: ") + std::strerror(errno)};
+    if(pid == 0){
+        ::close(toServer[1]);
+        ::close(fromServer[0]);
+        if(::chdir(source.c_str()) != 0) ::_exit(1);
+        FILE* in = ::fdopen(toServer[0], "r");
+        FILE* out = ::fdopen(fromServer[1], "w");
+        {
+            MiniGitRepo server;
+            server.serveUploadPack(in, out);
+        }
+        std::fclose(out);
+        ::_exit(0);
+    }
+    ::close(toServer[0]);
+    ::close(fromServer[1]);
+    FILE* out = ::fdopen(toServer[1], "w");
+    FILE* in = ::fdopen(fromServer[0], "r");
+
+    std::string line;
+    while(readLine(in, line) && line != "end"){
+        std::stringstream fields(line);
+        std::string kind, name, hash;
+        fields>> kind>> name>> hash;
+        if(kind == "ref") remoteRefs[name] = hash;
+        else if(kind == "head") remoteHead = name;
+    }
+
+    //wants, then haves: the newest commits of every local branch, thinning out exponentially
+    for(const auto& [name, hash] : remoteRefs){
+        if((wantBranch.empty() || name == wantBranch) && hash != "null" && !hash.empty()){
+            std::fprintf(out, "want %s\n", hash.c_str());
+        }
+    }
+    std::unordered_map<uint64_t, PathFilter> filters = loadPathFilters(pathFilterFile);
+    std::set<std::string> sent;
+    for(const auto& ref : listRefs()){
+        size_t depth = 0, nextSent = 0, step = 1;
+        for(std::string c = ref.second; c != "null" && !c.empty(); ++depth){
+            if(depth == nextSent){
+                if(!sent.insert(c).second) break;
+                std::fprintf(out, "have %s\n", c.c_str());
+                if(depth >= 16) step *= 2;
+                nextSent += step;
+            }
+            uint64_t id;
+            auto found = parseObjectId(c, id) ? filters.find(id) : filters.end();
+            if(found != filters.end()) c = found->second.hasParent ? formatObjectId(found->second.parent) : "null";
+            else c = commitParent(c);
+        }
+    }
+    std::fprintf(out, "done\n");
+    std::fflush(out);
+
+    size_t commitCount = 0, objectCount = 0, received = 0, bytes = 0;
+    if(readLine(in, line)) std::sscanf(line.c_str(), "pack %zu %zu", &commitCount, &objectCount);
+    std::vector<std::string> newCommits;
+    std::string malformed;
+    while(received < commitCount + objectCount && readLine(in, line)){
+        std::stringstream fields(line);
+        std::string kind, hash;
+        size_t size = 0;
+        fields>> kind>> hash>> size;
+        std::string data(size, '\0');
+        if(size > 0 && std::fread(&data[0], 1, size, in) != size) break;
+        ++received;
+        bytes += size;
+        if(kind == "object"){
+            if(computeHash(data) != hash){
+                stats.corrupt.push_back(hash);
+                continue;
+            }
+            if(!journalHas(objectPath(hash)) && !hasObject(hash)) journalWrite(objectPath(hash), data);
+        }else if(kind == "commit"){
+            CommitView view;
+            if(!view.parse(data)){
+                malformed = hash;
+                break;
+            }
+            packParents[hash] = view.parent();
+            recordLogTerms(hash, std::string(view.message()), std::string(view.author()));
+            fs::create_directories(baseDir + "/commits");
+            journalWrite(baseDir + "/commits/" + hash + ".txt", data);
+            newCommits.push_back(hash);
+        }
+    }
+    std::fclose(out);
+    std::fclose(in);
+    ::waitpid(pid, nullptr, 0);
+
+    //nothing from a pack that cannot be used is kept
+    stats.commits = commitCount;
+    stats.objects = objectCount;
+    stats.bytes = bytes;
+    if(!malformed.empty()){
+        discardJournal();
+        return Error{ErrorCode::SystemError, "fetch from '" + source + "' failed: commit " + malformed +
+                                             " in the pack is malformed."};
+    }
+    if(received != commitCount + objectCount){
+        discardJournal();
+        return Error{ErrorCode::SystemError, "fetch from '" + source + "' failed: the pack ended after " +
+                                             std::to_string(received) + " of " +
+                                             std::to_string(commitCount + objectCount) + " entries."};
+    }
+    for(const auto& c : newCommits){
+        MappedCommit commit;
+        bool complete = readCommit(c, commit) && commit.view().isComplete();
+        recordChangedPaths(c, packParents[c], changedPaths(loadTreeFiles(packParents[c]), loadCommitFiles(c), complete));
+    }
+    return Error();
+}
+
+Result<CloneResult> MiniGitRepo::clone(const std::string& source){
+    if(fs::exists(baseDir)){
+        return Error{ErrorCode::AlreadyExists, "a MiniGit repository already exists here."};
+    }
+    Result<std::string> created = init();
+    if(!created) return created.error;
+
+    CloneResult result;
+    std::map<std::string, std::string> remoteRefs, packParents;
+    std::string remoteHead;
+    Error fetched = fetchPack(source, "", remoteRefs, remoteHead, packParents, result.fetched);
+    if(fetched.code != ErrorCode::None) return fetched;
+    for(const auto& [name, hash] : remoteRefs){
+        fs::create_directories(fs::path(refsDir + "/" + name).parent_path());
+        journalRef(refsDir + "/" + name, hash);
+    }
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+
+    result.branches = remoteRefs.size();
+    if(!remoteRefs.count(remoteHead)) return result;
+    Result<CheckoutResult> checkedOut = checkout(remoteHead);
+    if(!checkedOut) return checkedOut.error;
+    result.head = remoteHead;
+    result.checkout = std::move(checkedOut.value);
+    return result;
+}
+
+Result<FetchResult> MiniGitRepo::fetch(const std::string& source, const std::string& branchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    FetchResult result;
+    std::map<std::string, std::string> remoteRefs, packParents;
+    std::string remoteHead;
+    Error fetched = fetchPack(source, branchName, remoteRefs, remoteHead, packParents, result);
+    if(fetched.code != ErrorCode::None) return fetched;
+    if(!remoteRefs.count(branchName)){
+        return Error{ErrorCode::UnknownBranch, "remote has no branch '" + branchName + "'."};
+    }
+
+    //only move the local branch when that loses nothing, otherwise leave the result in FETCH_HEAD
+    std::string newTip = remoteRefs[branchName];
+    std::string branchPath = refsDir + "/" + branchName;
+    std::string oldTip = fs::exists(branchPath) || journalHas(branchPath) ? readRef(branchPath) : "null";
+    bool fastForward = oldTip == "null" || oldTip.empty();
+    for(std::string c = newTip; !fastForward && c != "null" && !c.empty();){
+        if(c == oldTip) fastForward = true;
+        auto inPack = packParents.find(c);
+        c = inPack != packParents.end() ? inPack->second : commitParent(c);
+    }
+
+    journalRef(baseDir + "/FETCH_HEAD", newTip);
+    if(fastForward){
+        fs::create_directories(fs::path(branchPath).parent_path());
+        journalRef(branchPath, newTip);
+    }
+    Error flushed = commitJournal();
+    if(flushed.code != ErrorCode::None) return flushed;
+    result.tip = newTip;
+    result.fastForward = fastForward;
+    return result;
+}
+
+static std::vector<std::string> splitLines(const std::string& text){
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    std::string line;
+    while(std::getline(in, line)) lines.push_back(line);
+    return lines;
+}
+
+static std::vector<uint64_t> hashLines(const std::vector<std::string>& lines){
+    std::vector<uint64_t> hashes;
+    hashes.reserve(lines.size());
+    for(const auto& line : lines) hashes.push_back(std::hash<std::string>{}(line));
+    return hashes;
+}
+
+/*
+ Linear-space Myers diff on line hashes. Lines that occur on one side only can never
+ be kept, so they are dropped first; a full rewrite then costs nothing. The rest is
+ split at the middle snake of its shortest edit script and each half diffed on its own,
+ so memory stays O(n + m) whatever the edit distance.
+*/
+namespace{
+
+struct LineMatcher{
+    std::vector<uint64_t> a, b;          //lines that occur on both sides
+    std::vector<int> aIndex, bIndex;     //their positions in the full texts
+    std::vector<int>* match = nullptr;   //old index for every new line, or null to only count
+    size_t kept = 0;
+    std::vector<int> forward, backward;  //furthest x on each diagonal, reused at every level
+
+    void keep(int x, int y){
+        ++kept;
+        if(match) (*match)[bIndex[y]] = aIndex[x];
+    }
+    void run(int a0, int a1, int b0, int b1);
+};
+
+void LineMatcher::run(int a0, int a1, int b0, int b1){
+    while(a0 < a1 && b0 < b1 && a[a0] == b[b0]) keep(a0++, b0++);
+    while(a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]) keep(--a1, --b1);
+    int n = a1 - a0, m = b1 - b0;
+    if(n == 0 || m == 0) return;
+
+    //forward paths from (0, 0) and backward paths from (n, m) until they overlap
+    int maxD = (n + m + 1) / 2, off = maxD + 1, width = 2 * maxD + 3;
+    int delta = n - m;
+    bool odd = delta & 1;
+    forward.assign(width, -1);
+    backward.assign(width, -1);
+    forward[off + 1] = 0;
+    backward[off + 1] = 0;
+    int splitX = -1, splitY = -1;
+    int fStart = 0, fEnd = 0, bStart = 0, bEnd = 0; //diagonals that left the grid
+    for(int d = 0; d < maxD && splitX < 0; ++d){
+        for(int k = -d + fStart; k <= d - fEnd; k += 2){
+            int x = (k == -d || (k != d && forward[off + k - 1] < forward[off + k + 1])) ?
+                    forward[off + k + 1] : forward[off + k - 1] + 1;
+            int y = x - k;
+            while(x < n && y < m && a[a0 + x] == b[b0 + y]){ ++x; ++y; }
+            forward[off + k] = x;
+            if(x > n) fEnd += 2;
+            else if(y > m) fStart += 2;
+            else if(odd){
+                int other = off + delta - k;
+                if(other >= 0 && other < width && backward[other] != -1 && x >= n - backward[other]){
+                    splitX = x;
+                    splitY = y;
+                    break;
+                }
+            }
+        }
+        if(splitX >= 0) break;
+        for(int k = -d + bStart; k <= d - bEnd; k += 2){
+            int x = (k == -d || (k != d && backward[off + k - 1] < backward[off + k + 1])) ?
+                    backward[off + k + 1] : backward[off + k - 1] + 1;
+            int y = x - k;
+            while(x < n && y < m && a[a1 - 1 - x] == b[b1 - 1 - y]){ ++x; ++y; }
+            backward[off + k] = x;
+            if(x > n) bEnd += 2;
+            else if(y > m) bStart += 2;
+            else if(!odd){
+                int other = off + delta - k;
+                if(other >= 0 && other < width && forward[other] != -1 && forward[other] >= n - x){
+                    splitX = forward[other];
+                    splitY = splitX - (delta - k);
+                    break;
+                }
+            }
+        }
+    }
+    if(splitX < 0) return; //nothing in common
+
+    run(a0, a0 + splitX, b0, b0 + splitY);
+    run(a0 + splitX, a1, b0 + splitY, b1);
+}
+
+} //namespace
+
+//prepares a matcher over the lines a and b have in common
+static void loadLineMatcher(LineMatcher& matcher, const std::vector<uint64_t>& a, const std::vector<uint64_t>& b){
+    std::unordered_set<uint64_t> inA(a.begin(), a.end()), inB(b.begin(), b.end());
+    for(size_t i = 0; i < a.size(); ++i){
+        if(!inB.count(a[i])) continue;
+        matcher.a.push_back(a[i]);
+        matcher.aIndex.push_back(i);
+    }
+    for(size_t i = 0; i < b.size(); ++i){
+        if(!inA.count(b[i])) continue;
+        matcher.b.push_back(b[i]);
+        matcher.bIndex.push_back(i);
+    }
+}
+
+//for every line of b, the index of the line of a it was kept from, or -1
+static std::vector<int> matchLines(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b){
+    std::vector<int> match(b.size(), -1);
+    LineMatcher matcher;
+    loadLineMatcher(matcher, a, b);
+    matcher.match = &match;
+    matcher.run(0, matcher.a.size(), 0, matcher.b.size());
+    return match;
+}
+
+//how many lines of a are kept in b, without recording which
+static size_t countKeptLines(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b){
+    LineMatcher matcher;
+    loadLineMatcher(matcher, a, b);
+    matcher.run(0, matcher.a.size(), 0, matcher.b.size());
+    return matcher.kept;
+}
+
+/*
+ blame walks first-parent history once. Lines still unattributed are mapped through
+ a diff from each version of the file to the previous one; a line with no match in the
+ older version belongs to the commit that introduced the newer one. The walk stops
+ when every line has an owner, or at a commit whose blame of this path is cached in
+ .minigit/blame/<commit>-<path hash>, one owner per line.
+*/
+Result<std::vector<BlameLine>> MiniGitRepo::blame(const std::string& filename){
+    if(!fs::exists(baseDir)) return notARepository();
+    std::string head = headCommit();
+    if(head == "null"){
+        return Error{ErrorCode::NoCommits, "No commits yet."};
+    }
+    auto cachePath = [&](const std::string& commitHash){
+        return blameCacheDir + "/" + commitHash + "-" + computeHash(filename);
+    };
+    //a commit that lacks the file: only a complete one says it was deleted there,
+    //a partial one just did not stage it
+    bool deleted = false;
+    auto blobAt = [&](const std::string& commitHash) -> std::string{
+        MappedCommit commit;
+        deleted = false;
+        if(!readCommit(commitHash, commit)) return "";
+        PathTable paths;
+        for(const auto& entry : snapshotOf(commit.view(), paths).entries){
+            if(paths.path(entry.path) == filename) return formatObjectId(entry.blob);
+        }
+        deleted = commit.view().isComplete();
+        return "";
+    };
+
+    //the newest commit that records the file is where the blame starts
+    std::string start = head, blob;
+    while(start != "null" && !start.empty() && (blob = blobAt(start)).empty() && !deleted) start = commitParent(start);
+    if(blob.empty()){
+        return Error{ErrorCode::NotFound, "'" + filename + "' is not in the history of this branch."};
+    }
+
+    std::vector<std::string> lines = splitLines(readBlob(blob));
+    std::vector<std::string> owner(lines.size());
+    std::vector<int> position(lines.size()); //line index in the version being looked at
+    for(size_t i = 0; i < lines.size(); ++i) position[i] = i;
+    size_t open = lines.size();
+
+    std::string versionCommit = start, versionBlob = blob;
+    std::vector<uint64_t> versionHashes = hashLines(lines);
+    for(std::string c = start; open > 0 && c != "null" && !c.empty(); c = commitParent(c)){
+        std::string older = blobAt(c);
+        if(deleted) break; //lines older than a deletion are not this file's
+        if(older.empty()) continue;
+
+        if(older != versionBlob){
+            std::vector<uint64_t> olderHashes = hashLines(splitLines(readBlob(older)));
+            std::vector<int> match = matchLines(olderHashes, versionHashes);
+            for(size_t i = 0; i < lines.size(); ++i){
+                if(!owner[i].empty()) continue;
+                position[i] = match[position[i]];
+                if(position[i] < 0){
+                    owner[i] = versionCommit;
+                    --open;
+                }
+            }
+            versionBlob = older;
+            versionHashes = std::move(olderHashes);
+        }
+        versionCommit = c; //oldest commit seen so far with this content
+
+        //positions now index c's version, so an earlier blame of c answers the rest
+        std::ifstream cached(cachePath(c));
+        if(cached && c != start){
+            std::vector<std::string> cachedOwners;
+            std::string line;
+            while(std::getline(cached, line)) cachedOwners.push_back(line);
+            if(cachedOwners.size() != versionHashes.size()) continue;
+            for(size_t i = 0; i < lines.size(); ++i){
+                if(owner[i].empty()){
+                    owner[i] = cachedOwners[position[i]];
+                    --open;
+                }
+            }
+            break;
+        }
+    }
+    for(auto& o : owner){
+        if(o.empty()) o = versionCommit; //left over at the root: the oldest version wrote them
+    }
+
+    fs::create_directories(blameCacheDir);
+    std::stringstream cacheOut;
+    for(const auto& o : owner) cacheOut<< o<< "\n";
+    if(writeWholeFile(cachePath(start) + ".tmp", cacheOut.str())){
+        fs::rename(cachePath(start) + ".tmp", cachePath(start));
+    }
+
+    std::vector<BlameLine> result;
+    result.reserve(lines.size());
+    for(size_t i = 0; i < lines.size(); ++i){
+        result.push_back({std::move(owner[i]), std::move(lines[i])});
+    }
+    return result;
+}
+
+/*
+ In-memory merge and cherry-pick for callers such as a merge queue: they read only
+ commit files and write at most one commit object. The working tree, the index,
+ HEAD and the refs are never touched.
+*/
+Result<MergeResult> MiniGitRepo::mergeInMemory(const std::string& ours, const std::string& theirs, const std::string& message){
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    MergeResult outcome;
+    outcome.base = findLCA(baseDir + "/commits", ours, theirs);
+    PathTable paths;
+    Snapshot base = loadTree(outcome.base, paths);
+    Snapshot ourSnap = loadTree(ours, paths), theirSnap = loadTree(theirs, paths);
+    outcome.renames = followRenames(base, ourSnap, theirSnap, paths);
+    TreeMerge result = mergeSnapshots(base, ourSnap, theirSnap, paths);
+    outcome.conflicts = std::move(result.conflicts);
+    if(outcome.conflicts.empty()){
+        time_t now = time(0);
+        outcome.commit = writeCommit(message, message + ours + theirs + ctime(&now), ours, result.merged, paths);
+        Error flushed = commitJournal();
+        if(flushed.code != ErrorCode::None) return flushed;
+    }
+    return outcome;
+}
+
+//replay what commit changed relative to its parent on top of onto
+Result<MergeResult> MiniGitRepo::cherryPickInMemory(const std::string& commit, const std::string& onto){
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    MergeResult outcome;
+    outcome.base = commitParent(commit);
+    PathTable paths;
+    Snapshot base = loadTree(outcome.base, paths);
+    Snapshot ourSnap = loadTree(onto, paths), theirSnap = loadTree(commit, paths);
+    outcome.renames = followRenames(base, ourSnap, theirSnap, paths);
+    TreeMerge result = mergeSnapshots(base, ourSnap, theirSnap, paths);
+    outcome.conflicts = std::move(result.conflicts);
+    if(outcome.conflicts.empty()){
+        MappedCommit picked;
+        std::string message = readCommit(commit, picked) ? std::string(picked.view().message()) : "";
+        time_t now = time(0);
+        outcome.commit = writeCommit(message, message + commit + onto + ctime(&now), onto, result.merged, paths);
+        Error flushed = commitJournal();
+        if(flushed.code != ErrorCode::None) return flushed;
+    }
+    return outcome;
+}
+
+Result<MergeResult> MiniGitRepo::mergeTree(const std::string& ours, const std::string& theirs){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    Result<std::string> ourHash = resolveCommit(ours);
+    if(!ourHash) return ourHash.error;
+    Result<std::string> theirHash = resolveCommit(theirs);
+    if(!theirHash) return theirHash.error;
+    return mergeInMemory(ourHash.value, theirHash.value, "Merge " + theirs + " into " + ours);
+}
+
+//cherry-pick onto a branch (the current one by default) without touching the working tree;
+//on conflicts nothing is written and the result has no commit
+Result<MergeResult> MiniGitRepo::cherryPick(const std::string& commit, const std::string& branchName){
+    if(!fs::exists(baseDir)) return notARepository();
+    Error locked = lockForWrite();
+    if(locked.code != ErrorCode::None) return locked;
+    Result<std::string> resolved = resolveCommit(commit);
+    if(!resolved) return resolved.error;
+    std::string hash = resolved.value;
+    std::string branchPath;
+    if(branchName.empty()){
+        std::string headRef = readRef(headFile);
+        branchPath = baseDir + "/" + headRef.substr(5);
+    }else{
+        branchPath = refsDir + "/" + branchName;
+    }
+    if(!fs::exists(branchPath) && !journalHas(branchPath)){
+        return Error{ErrorCode::UnknownBranch, "Branch '" + branchName + "' does not exist."};
+    }
+    std::string onto = readRef(branchPath);
+
+    Result<MergeResult> outcome = cherryPickInMemory(hash, onto);
+    if(outcome && outcome.value.conflicts.empty()){
+        journalRef(branchPath, outcome.value.commit);
+        Error flushed = commitJournal();
+        if(flushed.code != ErrorCode::None) return flushed;
+    }
+    return outcome;
+}
+
+//line hashes of a text, matching hashLines(splitLines(text)) without copying the lines out
+static std::vector<uint64_t> hashTextLines(std::string_view text){
+    std::vector<uint64_t> hashes;
+    size_t pos = 0;
+    while(pos < text.size()){
+        size_t end = text.find('\n', pos);
+        if(end == std::string_view::npos) end = text.size();
+        hashes.push_back(std::hash<std::string_view>{}(text.substr(pos, end - pos)));
+        pos = end + 1;
+    }
+    return hashes;
+}
+
+//runs of unmatched lines between two versions, given matchLines' old index for every new line
+static std::vector<Hunk> buildHunks(const std::vector<int>& match, size_t oldCount){
+    std::vector<Hunk> hunks;
+    size_t i = 0, j = 0;
+    while(i < oldCount || j < match.size()){
+        if(j < match.size() && match[j] == static_cast<int>(i)){
+            ++i;
+            ++j;
+            continue;
+        }
+        Hunk hunk{i, 0, j, 0};
+        while(j < match.size() && match[j] < 0) ++j;
+        size_t next = j < match.size() ? match[j] : oldCount;
+        hunk.oldCount = next - i;
+        hunk.newCount = j - hunk.newStart;
+        i = next;
+        hunks.push_back(hunk);
+    }
+    return hunks;
+}
+
+/*
+ diff: one FileDiff per changed path, renames and copies folded into their new path.
+ Paths with identical blobs are skipped without reading them, Names stops at the
+ paths, binary blobs are only sized, and Counts only counts the lines the linear-space
+ diff keeps, without splitting the texts; only Hunks keeps the lines and the match.
+*/
+Result<std::vector<FileDiff>> MiniGitRepo::diff(const std::string& commit1, const std::string& commit2, DiffDetail detail){
+    if(!fs::exists(baseDir)) return notARepository();
+    Result<std::string> from = resolveCommit(commit1);
+    if(!from) return from.error;
+    Result<std::string> to = resolveCommit(commit2);
+    if(!to) return to.error;
+
+    PathTable paths;
+    Snapshot snap1 = loadTree(from.value, paths);
+    Snapshot snap2 = loadTree(to.value, paths);
+
+    std::vector<FileDiff> changes;
+    std::vector<std::pair<uint64_t, uint64_t>> blobs; //old and new blob of each change, 0 when absent
+
+    std::unordered_map<uint32_t, const Rename*> renamedTo;
+    std::set<uint32_t> renamedFrom;
+    std::vector<Rename> renames = detectRenames(snap1, snap2, paths);
+    for(const auto& r : renames){
+        renamedTo[r.to] = &r;
+        if(!r.copy) renamedFrom.insert(r.from);
+    }
+    std::unordered_map<uint32_t, uint64_t> blobs1;
+    for(const auto& entry : snap1.entries) blobs1[entry.path] = entry.blob;
+
+    //walk both sorted snapshots together; every changed path of either side shows up once, in order
+    const auto& files1 = snap1.entries;
+    const auto& files2 = snap2.entries;
+    size_t i = 0, j = 0;
+    while(i < files1.size() || j < files2.size()){
+        int order = i == files1.size() ? 1 : j == files2.size() ? -1 :
+                    paths.path(files1[i].path).compare(paths.path(files2[j].path));
+        const SnapshotEntry* entry1 = order <= 0 ? &files1[i++] : nullptr;
+        const SnapshotEntry* entry2 = order >= 0 ? &files2[j++] : nullptr;
+
+        FileDiff change;
+        if(entry1 && entry2){
+            if(entry1->blob == entry2->blob) continue;
+            change.path = std::string(paths.path(entry2->path));
+            blobs.push_back({entry1->blob, entry2->blob});
+        }else if(entry1){
+            if(renamedFrom.count(entry1->path)) continue;
+            change.status = 'D';
+            change.path = std::string(paths.path(entry1->path));
+            blobs.push_back({entry1->blob, 0});
+        }else{
+            change.path = std::string(paths.path(entry2->path));
+            auto moved = renamedTo.find(entry2->path);
+            if(moved == renamedTo.end()){
+                change.status = 'A';
+                blobs.push_back({0, entry2->blob});
+            }else{
+                const Rename& r = *moved->second;
+                change.status = r.copy ? 'C' : 'R';
+                change.oldPath = std::string(paths.path(r.from));
+                change.similarity = r.similarity;
+                blobs.push_back({blobs1[r.from], entry2->blob});
+            }
+        }
+        changes.push_back(std::move(change));
+    }
+    if(detail == DiffDetail::Names) return changes;
+
+    for(size_t c = 0; c < changes.size(); ++c){
+        FileDiff& change = changes[c];
+        auto [blob1, blob2] = blobs[c];
+        if(blob1 == blob2) continue;
+        //sizes and the binary check never load a whole blob; only text is read, for its lines
+        bool binary1 = false, binary2 = false;
+        if(blob1) change.oldSize = blobSize(formatObjectId(blob1), binary1);
+        if(blob2) change.newSize = blobSize(formatObjectId(blob2), binary2);
+        if(binary1 || binary2){
+            change.binary = true;
+            continue;
+        }
+        std::string content1, content2;
+        if(blob1) content1 = readBlob(formatObjectId(blob1));
+        if(blob2) content2 = readBlob(formatObjectId(blob2));
+
+        std::vector<uint64_t> lines1, lines2;
+        if(detail == DiffDetail::Hunks){
+            change.oldLines = splitLines(content1);
+            change.newLines = splitLines(content2);
+            lines1 = hashLines(change.oldLines);
+            lines2 = hashLines(change.newLines);
+        }else{
+            lines1 = hashTextLines(content1);
+            lines2 = hashTextLines(content2);
+        }
+        size_t kept;
+        if(detail == DiffDetail::Hunks){
+            std::vector<int> match = matchLines(lines1, lines2);
+            kept = match.size() - std::count(match.begin(), match.end(), -1);
+            change.hunks = buildHunks(match, lines1.size());
+        }else{
+            kept = countKeptLines(lines1, lines2);
+        }
+        change.deleted = lines1.size() - kept;
+        change.inserted = lines2.size() - kept;
+    }
+    return changes;
+}
+
+/*
+ Position of needle in hay at or after from, or npos. With AVX2 the first and last
+ needle bytes are compared against 32 positions at once and only positions where
+ both match are checked in full.
+*/
+static size_t findLiteral(std::string_view hay, std::string_view needle, size_t from){
+    if(needle.empty()) return from <= hay.size() ? from : std::string_view::npos;
+    if(hay.size() < needle.size() || from > hay.size() - needle.size()) return std::string_view::npos;
+    size_t i = from;
+#ifdef __AVX2__
+    const size_t last = needle.size() - 1;
+    const __m256i firstByte = _mm256_set1_epi8(needle[0]);
+    const __m256i lastByte = _mm256_set1_epi8(needle[last]);
+    for(; i + last + 32 <= hay.size(); i += 32){
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay.data() + i));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay.data() + i + last));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, firstByte),
+                                                              _mm256_cmpeq_epi8(tail, lastByte)));
+        while(mask){
+            int bit = __builtin_ctz(mask);
+            if(std::memcmp(hay.data() + i + bit, needle.data(), needle.size()) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return hay.find(needle, i);
+}
+
+/*
+ Longest run of literal characters every match of an ECMAScript pattern must contain,
+ or "" when there is none (alternation, or only classes and wildcards). Sets pure when
+ the whole pattern is one literal and needs no regex at all.
+*/
+static std::string requiredLiteral(const std::string& pattern, bool& pure){
+    pure = true;
+    std::string best, run;
+    int depth = 0;
+    auto endRun = [&](){
+        if(run.size() > best.size()) best = run;
+        run.clear();
+    };
+    for(size_t i = 0; i < pattern.size(); ++i){
+        char c = pattern[i];
+        if(c == '|'){
+            pure = false;
+            return "";
+        }
+        if(c == '\\' && i + 1 < pattern.size()){
+            char next = pattern[++i];
+            if(std::isalnum(static_cast<unsigned char>(next))){
+                pure = false;
+                endRun();
+                continue;
+            }
+            c = next;
+        }else if(std::strchr(".^$[](){}*+?", c)){
+            pure = false;
+            if(c == '*' || c == '?' || c == '{'){
+                //the character before an optional quantifier is not required
+                if(!run.empty()) run.pop_back();
+            }
+            if(c == '[') while(i + 1 < pattern.size() && pattern[++i] != ']'){}
+            if(c == '(') ++depth;
+            if(c == ')') --depth;
+            if(c == '{') while(i + 1 < pattern.size() && pattern[++i] != '}'){}
+            endRun();
+            continue;
+        }
+        if(depth == 0) run += c;
+    }
+    endRun();
+    return best;
+}
+
+/*
+ Search the files of a commit (HEAD by default). Each distinct blob is read and
+ searched once on a worker per core; a blob that lacks the pattern's required
+ literal is rejected by the SIMD scan without running the regex.
+*/
+Result<std::vector<GrepMatch>> MiniGitRepo::grep(const std::string& pattern, const std::string& commit){
+    if(!fs::exists(baseDir)) return notARepository();
+    Result<std::string> resolved = resolveCommit(commit.empty() ? "HEAD" : commit);
+    if(!resolved) return resolved.error;
+    std::string hash = resolved.value;
+
+    bool pure = false;
+    std::string literal = requiredLiteral(pattern, pure);
+    std::regex re;
+    if(!pure){
+        try{
+            re = std::regex(pattern);
+        }catch(const std::regex_error& e){
+            return Error{ErrorCode::InvalidArgument, "invalid pattern '" + pattern + "': " + e.what()};
+        }
+    }
+
+    PathTable paths;
+    Snapshot snap = loadTree(hash, paths);
+    std::vector<uint64_t> blobs;
+    std::unordered_map<uint64_t, size_t> blobSlot;
+    for(const auto& entry : snap.entries){
+        if(blobSlot.emplace(entry.blob, blobs.size()).second) blobs.push_back(entry.blob);
+    }
+
+    //per blob: matching lines as (line number, text), or a binary marker
+    struct Hits{
+        bool binary = false;
+        std::vector<std::pair<size_t, std::string>> lines;
+    };
+    std::vector<Hits> hits(blobs.size());
+    std::atomic<size_t> next(0);
+    unsigned workers = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), blobs.size()));
+    std::vector<std::thread> pool;
+    for(unsigned w = 0; w < workers; ++w){
+        pool.emplace_back([&](){
+            size_t idx;
+            while((idx = next.fetch_add(1)) < blobs.size()){
+                std::string content = readBlob(formatObjectId(blobs[idx]));
+                std::string_view text(content);
+                size_t candidate = findLiteral(text, literal, 0);
+                if(candidate == std::string_view::npos) continue;
+
+                bool binary = looksBinary(text);
+                size_t lineStart = 0, lineNum = 1;
+                while(lineStart < text.size()){
+                    //jump straight to the next line holding the literal
+                    if(!literal.empty()){
+                        candidate = findLiteral(text, literal, lineStart);
+                        if(candidate == std::string_view::npos) break;
+                        size_t skipTo = text.rfind('\n', candidate);
+                        skipTo = skipTo == std::string_view::npos || skipTo < lineStart ? lineStart : skipTo + 1;
+                        lineNum += std::count(text.begin() + lineStart, text.begin() + skipTo, '\n');
+                        lineStart = skipTo;
+                    }
+                    size_t lineEnd = text.find('\n', lineStart);
+                    if(lineEnd == std::string_view::npos) lineEnd = text.size();
+                    std::string_view line = text.substr(lineStart, lineEnd - lineStart);
+                    bool matched = pure || std::regex_search(line.begin(), line.end(), re);
+                    if(matched){
+                        if(binary){
+                            hits[idx].binary = true;
+                            break;
+                        }
+                        hits[idx].lines.emplace_back(lineNum, std::string(line));
+                    }
+                    lineStart = lineEnd + 1;
+                    ++lineNum;
+                }
+            }
+        });
+    }
+    for(auto& t : pool) t.join();
+
+    std::vector<GrepMatch> matches;
+    for(const auto& entry : snap.entries){
+        const Hits& found = hits[blobSlot[entry.blob]];
+        std::string path(paths.path(entry.path));
+        if(found.binary){
+            matches.push_back({path, 0, "", true});
+            continue;
+        }
+        for(const auto& [lineNum, line] : found.lines){
+            matches.push_back({path, lineNum, line, false});
+        }
     }
+    return matches;
 }
 
+} //namespace minigit
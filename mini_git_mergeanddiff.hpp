@@ -2,26 +2,647 @@
 #define MINI_GIT_HPP
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <array>
+#include <bitset>
+#include <mutex>
+
+//everything the library defines lives in this namespace; its helpers have internal linkage
+namespace minigit{
+
+//persistent object-ID set: an mmap'd Bloom filter and sorted table, plus an append log of newer IDs
+class ObjectIdIndex{
+    public:
+    enum Lookup{ Absent, Present, Unknown };
+
+    explicit ObjectIdIndex(const std::string& indexPath);
+    ~ObjectIdIndex();
+    ObjectIdIndex(const ObjectIdIndex&) = delete;
+    ObjectIdIndex& operator=(const ObjectIdIndex&) = delete;
+
+    Lookup lookup(uint64_t id);
+    std::vector<uint64_t> range(uint64_t low, uint64_t high, size_t limit);
+    void insert(uint64_t id);
+    void rebuild(std::vector<uint64_t> ids);
+    bool needsCompaction();
+    std::vector<uint64_t> allIds();
+
+    private:
+    const std::string path;
+    const std::string logPath;
+    bool opened = false;
+    unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    uint64_t count = 0;
+    uint64_t bloomBits = 0;
+    uint32_t hashCount = 0;
+    std::vector<uint64_t> logIds;
+
+    bool open();
+    void close();
+    const uint64_t* table() const;
+    unsigned char* bloom() const;
+    bool bloomTest(uint64_t id) const;
+    void bloomSet(uint64_t id);
+};
+
+//one posting of the commit message index: a hashed term and a commit that contains it
+struct Posting{
+    uint64_t term;
+    uint64_t commit;
+};
+
+//persistent inverted index: an mmap'd table of postings sorted by term, plus an append log
+class TermIndex{
+    public:
+    explicit TermIndex(const std::string& indexPath);
+    ~TermIndex();
+    TermIndex(const TermIndex&) = delete;
+    TermIndex& operator=(const TermIndex&) = delete;
+
+    bool available();
+    std::vector<uint64_t> lookup(uint64_t term);
+    void rebuild(std::vector<Posting> postings);
+    bool needsCompaction();
+    std::vector<Posting> allPostings();
+    void close(); //forget the mapping; the next lookup rereads both files
+
+    private:
+    const std::string path;
+    const std::string logPath;
+    bool opened = false;
+    unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    uint64_t count = 0;
+    std::vector<Posting> logPostings;
+
+    bool open();
+    const Posting* table() const;
+};
+
+/*
+ Glob rules in .minigitignore syntax ('*', '?', '[a-z]', '**', '!negate', 'dir/',
+ '/anchored'), compiled into one automaton. An NFA is built from every rule and a
+ DFA over it is filled in lazily, so matching costs one table step per byte however
+ many rules there are. Walks carry the state reached at a directory and step only
+ the next name from there. Safe to share between threads.
+*/
+class PathMatcher{
+    public:
+    static const int start = 0;
+
+    bool load(const std::string& file);
+    void addRule(const std::string& line);
+    bool empty() const { return rules.empty(); }
+
+    int step(int state, std::string_view text);
+    bool matches(int state, bool isDir);
+    bool matches(std::string_view path, bool isDir);
+    bool matchesPathOrParent(std::string_view path, bool isDir);
+
+    private:
+    struct Rule{
+        bool negate;
+        bool dirOnly;
+    };
+    struct NfaState{
+        std::bitset<256> bytes; //bytes that advance to next; none for a split or an accept
+        int next = -1;
+        int alt = -1;           //second epsilon edge of a split
+        int rule = -1;          //accepting state of this rule
+    };
+    struct DfaState{
+        std::vector<int> nfa;
+        std::array<int, 256> next;
+        int fileRule = -1; //last rule that matches a file ending here
+        int dirRule = -1;  //same for a directory
+    };
+    std::vector<Rule> rules;
+    std::vector<NfaState> nfa;
+    std::vector<int> ruleStarts;
+    std::vector<DfaState> dfa;
+    std::map<std::vector<int>, int> dfaIds;
+    std::mutex lock;
+
+    int addNfaState(const std::bitset<256>& bytes, int next, int alt = -1);
+    void closure(int state, std::vector<int>& out) const;
+    int dfaState(std::vector<int> states);
+    int advance(int state, unsigned char c);
+};
+
+//bump allocator: strings copied in live as long as the arena, freed all at once
+class Arena{
+    public:
+    std::string_view copy(std::string_view text);
+
+    private:
+    static const size_t blockSize = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t used = blockSize;
+};
+
+//interned paths shared by the snapshots that get compared with each other
+class PathTable{
+    public:
+    uint32_t intern(std::string_view path);
+    std::string_view path(uint32_t id) const { return paths[id]; }
+
+    private:
+    Arena arena;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> paths;
+};
+
+//one file of a snapshot: interned path and the binary blob id
+struct SnapshotEntry{
+    uint32_t path;
+    uint64_t blob;
+};
+
+//files of a commit as a flat vector sorted by path, ready for linear merge-joins
+struct Snapshot{
+    std::vector<SnapshotEntry> entries;
+};
+
+//one file of a decoded commit: its path and the binary blob id
+struct CommitEntry{
+    std::string_view path;
+    uint64_t blob;
+};
+
+/*
+ A commit decoded in place from the binary or the legacy text encoding. Every view
+ points into the buffer given to parse(), which must outlive it. Binary entries are
+ read straight from the fixed-width table; text entries are scanned into a list once.
+*/
+class CommitView{
+    public:
+    bool parse(std::string_view data);
+    bool isBinary() const { return binary; }
+    bool isComplete() const { return complete; } //lists the whole tree, not just what was staged
+    std::string_view message() const { return messageText; }
+    std::string_view author() const { return authorText; }
+    std::string timestamp() const;
+    std::string parent() const;
+    size_t size() const { return binary ? entryCount : textEntries.size(); }
+    CommitEntry entry(size_t i) const;
+
+    private:
+    bool binary = false;
+    bool complete = false;
+    std::string_view messageText, authorText, timestampText, parentText;
+    int64_t epoch = 0;
+    bool hasParent = false;
+    uint64_t parentId = 0;
+    const char* entryTable = nullptr;
+    const char* pathBytes = nullptr;
+    size_t entryCount = 0;
+    size_t pathBytesSize = 0;
+    std::vector<CommitEntry> textEntries;
+};
+
+//a commit file mapped read-only (or a pending journal copy) and decoded without copying
+class MappedCommit{
+    public:
+    MappedCommit() = default;
+    ~MappedCommit();
+    MappedCommit(const MappedCommit&) = delete;
+    MappedCommit& operator=(const MappedCommit&) = delete;
+
+    bool open(const std::string& file);
+    bool load(std::string_view data);
+    const CommitView& view() const { return commit; }
+
+    private:
+    void* map = nullptr;
+    size_t mapSize = 0;
+    CommitView commit;
+};
+
+//result of a three-way merge of snapshots; conflicting paths keep "ours"
+struct TreeMerge{
+    Snapshot merged;
+    std::vector<std::string> conflicts;
+};
+
+//a file of one snapshot found again under another path in a later one, similarity in percent
+struct Rename{
+    uint32_t from;
+    uint32_t to;
+    int similarity;
+    bool copy;
+};
+
+//changed-path Bloom filter of one commit, with the parent it was computed against
+struct PathFilter{
+    uint64_t parent = 0;
+    bool hasParent = false;
+    std::string bits;
+};
+
+/*
+ Library API. Every public MiniGitRepo operation returns its data as one of the
+ structs below wrapped in a Result; nothing is printed, that is the CLI's job.
+*/
+
+//what went wrong in a library call; None on success
+enum class ErrorCode{
+    None,
+    NotARepository,
+    AlreadyExists,
+    NotFound,
+    UnknownCommit,
+    AmbiguousCommit,
+    UnknownBranch,
+    NoCommits,
+    InvalidArgument,
+    WriteFailed,
+    LockFailed,
+    SystemError, //a pipe, fork or transfer to another process failed
+};
+
+struct Error{
+    ErrorCode code = ErrorCode::None;
+    std::string message;
+};
+
+//value of a library call, or the typed error that prevented it
+template<typename T>
+struct Result{
+    T value{};
+    Error error;
+
+    Result() = default;
+    Result(T v) : value(std::move(v)){}
+    Result(Error e) : error(std::move(e)){}
+    explicit operator bool() const { return error.code == ErrorCode::None; }
+};
+
+struct AddResult{
+    std::string path;
+    std::string blob;
+    bool stored = false; //false when the blob was already in the object store
+    size_t chunks = 0;   //chunks of a large file, 0 when it is stored whole
+    size_t newChunks = 0;
+    bool removed = false; //the path is gone from the working tree and its removal is staged
+};
+
+struct CommitResult{
+    std::string hash;
+    std::vector<std::string> removed; //staged paths that no longer exist and left the tree
+    std::vector<std::string> skipped; //staged paths that no longer exist and were never committed
+};
+
+struct CommitInfo{
+    std::string hash;
+    std::string message;
+    std::string author;
+    std::string timestamp;
+    std::string parent;
+};
+
+//log filters; empty fields do not filter
+struct LogFilter{
+    std::string path;
+    std::string grep;
+    std::string author;
+};
+
+struct RestoredFile{
+    std::string path;
+    bool restored = false; //false when its blob is missing
+};
+
+struct CheckoutResult{
+    std::string commit; //"" when the branch has no commits yet
+    std::vector<RestoredFile> files;
+    std::vector<std::string> removed; //clean files that left the sparse-checkout patterns
+    size_t skipped = 0;               //files outside the sparse-checkout patterns
+};
+
+//merge, merge-tree or cherry-pick: the new commit, or the conflicts that prevented it
+struct MergeResult{
+    std::string base;
+    std::string commit;
+    std::vector<std::string> conflicts;
+    std::vector<std::string> renames; //"old -> new" moves whose edits were carried over
+};
+
+//a run of changed lines: [oldStart, oldStart + oldCount) became [newStart, newStart + newCount)
+struct Hunk{
+    size_t oldStart;
+    size_t oldCount;
+    size_t newStart;
+    size_t newCount;
+};
+
+enum class DiffDetail{
+    Names,  //status and paths only
+    Counts, //plus inserted/deleted line counts and binary sizes
+    Hunks,  //plus the lines and hunks
+};
+
+struct FileDiff{
+    char status = 'M'; //A, D, M, R (renamed) or C (copied)
+    std::string path;
+    std::string oldPath; //source of a rename or copy
+    int similarity = 100;
+    bool binary = false;
+    size_t oldSize = 0;
+    size_t newSize = 0;
+    size_t inserted = 0;
+    size_t deleted = 0;
+    std::vector<std::string> oldLines;
+    std::vector<std::string> newLines;
+    std::vector<Hunk> hunks;
+};
+
+enum class FileState{
+    New,
+    Modified,
+    Deleted,
+    Unchanged,
+};
+
+struct StatusEntry{
+    std::string path;
+    FileState state;
+};
+
+struct StatusReport{
+    std::string head;
+    std::vector<StatusEntry> staged;
+    std::vector<StatusEntry> unstaged;
+    std::vector<std::string> untracked;
+};
+
+struct GrepMatch{
+    std::string path;
+    size_t line = 0;
+    std::string text;
+    bool binary = false; //a binary blob matched; line and text are empty
+};
+
+struct BlameLine{
+    std::string commit;
+    std::string text;
+};
+
+struct FsckReport{
+    size_t objects = 0;
+    size_t commits = 0;
+    std::vector<std::string> problems;
+    std::vector<std::string> danglingCommits;
+    std::vector<std::string> danglingObjects;
+};
+
+struct PruneReport{
+    size_t reachable = 0;
+    size_t unreachable = 0;
+    size_t kept = 0; //unreachable but inside the grace period
+    size_t pruned = 0;
+};
+
+struct MigrateReport{
+    size_t total = 0; //objects found in the flat layout, 0 when the store already uses fan-out
+    size_t moved = 0;
+};
+
+//fsmonitor start, stop or status
+struct FsmonitorState{
+    bool running = false;
+    int pid = 0;       //the daemon just started or stopped
+    std::string token; //status: the point the next scan asks for changes since
+};
+
+struct FetchResult{
+    size_t commits = 0;
+    size_t objects = 0;
+    size_t bytes = 0;
+    std::vector<std::string> corrupt; //objects dropped because their content did not match their hash
+    std::string tip;                  //fetched tip of the branch
+    bool fastForward = false;         //false: the branch has diverged and the tip is only in FETCH_HEAD
+};
+
+struct CloneResult{
+    FetchResult fetched;
+    size_t branches = 0;
+    std::string head; //branch checked out, "" when the remote HEAD names no branch
+    CheckoutResult checkout;
+};
+
+class MiniGitRepo;
+
+//walks history from a commit towards the root, yielding the commits a LogFilter lets through
+class CommitIterator{
+    public:
+    bool next(CommitInfo& info);
+    const Error& error() const { return failure; }
+
+    private:
+    friend class MiniGitRepo;
+    const MiniGitRepo* repo = nullptr;
+    std::string current;
+    std::string limit;
+    std::unordered_map<uint64_t, PathFilter> filters;
+    bool filtered = false;
+    bool indexed = false; //candidates came from the log index; without one every commit is checked
+    std::vector<uint64_t> candidates;
+    std::vector<std::string> grepTerms;
+    std::vector<std::string> authorTerms;
+    Error failure;
+};
+
+//stat data of a working file plus the blob hash it had when last looked at
+struct StatEntry{
+    int64_t mtimeNs = 0;
+    int64_t size = -1;
+    uint64_t inode = 0;
+    std::string hash;
+};
+
+/*
+ Where a repository keeps its files. The main worktree has a .minigit directory that
+ is both; a linked worktree has a .minigit file "minigitdir: <common>/worktrees/<name>"
+ naming its private directory inside the main repository.
+*/
+struct RepoDirs{
+    std::string common;   //objects, commits, refs, indexes, lock and journal, shared by all worktrees
+    std::string worktree; //HEAD, index, stat cache, fsmonitor and sparse-checkout of this worktree
+    bool linked = false;
+};
+
+RepoDirs locateRepository();
+
+struct WorktreeInfo{
+    std::string path;
+    std::string branch;
+    bool linked = false;
+};
 
 class MiniGitRepo{
-private:
-    const std::string baseDir = ".minigit";
-        const std::string objectsDir = ".minigit/objects";
-            const std::string refsDir = ".minigit/refs";
-                const std::string headFile = ".minigit/HEAD";
-                    const std::string mainRefFile = ".minigit/refs/main";
-
-                    public:
-                        void init();
-                            void add(const std::string& filename);
-                                void commit(const std::string& message);
-                                    void log();
-                                        void branch(const std::string& branchName);
-                                            void checkout(const std::string& branchName);
-                                                void merge(const std::string& otherBranchName);
-                                                    void diff(const std::string& commit1, const std::string& commit2);
-                                                    };
-
-                                                    #endif
-
-                                                    
\ No newline at end of file
+    friend class CommitIterator;
+
+    private:
+    const RepoDirs dirs;
+    const std::string workTreeEntry = ".minigit"; //the repository's entry in the working tree, never walked
+    const std::string baseDir = dirs.common;
+    const std::string objectsDir = baseDir + "/objects";
+    const std::string refsDir = baseDir + "/refs";
+    const std::string worktreesDir = baseDir + "/worktrees";
+    const std::string headFile = dirs.worktree + "/HEAD";
+    const std::string mainRefFile = baseDir + "/refs/main";
+    const std::string journalFile = baseDir + "/journal";
+    const std::string objectIndexFile = baseDir + "/objects.idx";
+    const std::string commitIndexFile = baseDir + "/commits.idx";
+    const std::string pathFilterFile = baseDir + "/commit-paths";
+    const std::string statCacheFile = dirs.worktree + "/statcache";
+    const std::string fsmonitorPidFile = dirs.worktree + "/fsmonitor.pid";
+    const std::string fsmonitorLogFile = dirs.worktree + "/fsmonitor.log";
+    const std::string bitmapIdsFile = baseDir + "/bitmap-ids";
+    const std::string bitmapsFile = baseDir + "/bitmaps";
+    const std::string blameCacheDir = baseDir + "/blame";
+    const std::string logIndexFile = baseDir + "/log-index";
+    const std::string indexFile = dirs.worktree + "/index";
+    const std::string lockFile = baseDir + "/lock";
+    const std::string ignoreFile = ".minigitignore";
+    const std::string sparseFile = dirs.worktree + "/sparse-checkout";
+
+    //single-writer lock: held by commands that change the repository, never by readers
+    int lockFd = -1;
+    bool acquireLock(bool wait);
+    void releaseLock();
+    Error lockForWrite();
+
+    //write-ahead journal: object, commit and ref writes waiting for the next group flush
+    struct JournalEntry{
+        std::string path;
+        std::string content;
+        bool isRef;
+        bool isAppend = false; //content is added to the end of an existing file
+    };
+    std::vector<JournalEntry> journalEntries;
+    int batchDepth = 0;
+
+    std::unordered_set<std::string> journalPaths; //every path in journalEntries, for journalHas
+    void journalWrite(const std::string& path, std::string content);
+    void journalRef(const std::string& refPath, const std::string& value);
+    void journalAppend(const std::string& path, const std::string& bytes);
+    bool journalHas(const std::string& path) const;
+    std::string readRef(const std::string& refPath) const;
+    size_t journalBytes = 0;
+    Error journalFailure; //why the current group was dropped; later writes of the group are ignored
+    Error commitJournal();
+    Error flushJournal(bool includeRefs = true);
+    void discardJournal();
+    void recoverJournal();
+    Error recovery; //what recoverJournal() had to discard, reported as a warning
+    void indexPublished(const std::vector<std::string>& published);
+
+    std::string objectPath(const std::string& hash) const;
+    std::string findObject(const std::string& hash) const;
+
+    ObjectIdIndex objectIndex{objectIndexFile};
+    bool hasObject(const std::string& hash);
+    void rebuildObjectIndex();
+
+    ObjectIdIndex commitIndex{commitIndexFile};
+    void rebuildCommitIndex();
+    std::vector<std::string> commitsWithPrefix(const std::string& prefix, size_t limit);
+
+    std::string storeChunkedFile(const std::string& filename, AddResult& result);
+    std::string readBlob(const std::string& hash) const;
+    size_t blobSize(const std::string& hash, bool& binary) const;
+    bool restoreBlob(const std::string& hash, const std::string& filename) const;
+
+    bool readCommit(const std::string& hash, MappedCommit& commit) const;
+    std::map<std::string, std::string> loadCommitFiles(const std::string& hash) const;
+    Snapshot loadSnapshot(const std::string& hash, PathTable& paths) const;
+    Snapshot loadTree(const std::string& hash, PathTable& paths) const;
+    std::map<std::string, std::string> loadTreeFiles(const std::string& hash) const;
+    void recordChangedPaths(const std::string& commitHash, const std::string& parentHash,
+                            const std::vector<std::string>& changed);
+
+    TermIndex logIndex{logIndexFile};
+    void recordLogTerms(const std::string& commitHash, const std::string& message, const std::string& author);
+    void rebuildLogIndex();
+
+    std::string headCommit() const;
+    std::string commitParent(const std::string& hash) const;
+    std::map<std::string, std::string> listRefs() const;
+    std::vector<uint64_t> blobObjects(uint64_t blob) const;
+    std::vector<Rename> detectRenames(const Snapshot& from, const Snapshot& to, const PathTable& paths) const;
+    std::vector<std::string> followRenames(Snapshot& base, Snapshot& ours, Snapshot& theirs, const PathTable& paths) const;
+    Result<std::string> resolveCommit(const std::string& name);
+    std::string writeCommit(const std::string& message, const std::string& hashSeed, const std::string& parent,
+                            const Snapshot& snap, PathTable& paths);
+
+    void serveUploadPack(FILE* in, FILE* out);
+    Error fetchPack(const std::string& source, const std::string& wantBranch,
+                    std::map<std::string, std::string>& remoteRefs, std::string& remoteHead,
+                    std::map<std::string, std::string>& packParents, FetchResult& stats);
+    std::vector<std::string> readIndex() const;
+    std::map<std::string, StatEntry> scanWorkingTree(const std::set<std::string>& tracked,
+                                                     std::string* deferredToken = nullptr);
+    bool loadSparse(PathMatcher& sparse) const;
+    std::string checkedOutIn(const std::string& branchName) const;
+    std::vector<std::string> stagedInAllWorktrees() const;
+
+    std::string fsmonitorToken() const;
+    bool fsmonitorChanges(const std::string& since, std::set<std::string>& changed) const;
+    void runFsmonitor();
+
+    public:
+    MiniGitRepo();
+    explicit MiniGitRepo(const RepoDirs& dirs);
+    ~MiniGitRepo();
+
+    void beginBatch();
+    Error endBatch();
+
+    Result<std::string> init();
+    Result<AddResult> add(const std::string& filename);
+    Result<std::vector<AddResult>> add(const std::vector<std::string>& filenames);
+    Result<CommitResult> commit(const std::string& message);
+    Result<CommitIterator> log(const LogFilter& filter = LogFilter());
+    Result<std::string> branch(const std::string& branchName);
+    Result<CheckoutResult> checkout(const std::string& branchName);
+    Result<MergeResult> merge(const std::string& otherBranchName);
+    Result<std::vector<FileDiff>> diff(const std::string& commit1, const std::string& commit2,
+                                       DiffDetail detail = DiffDetail::Hunks);
+    Result<StatusReport> status();
+    Result<CheckoutResult> setSparsePatterns(const std::vector<std::string>& patterns);
+    std::vector<std::string> sparsePatterns() const;
+    Result<CheckoutResult> addWorktree(const std::string& path, const std::string& branchName);
+    Result<std::vector<WorktreeInfo>> worktrees() const;
+    Result<std::vector<GrepMatch>> grep(const std::string& pattern, const std::string& commit);
+    Result<std::vector<BlameLine>> blame(const std::string& filename);
+    Result<FsckReport> fsck();
+    Result<PruneReport> prune(long long expireSeconds);
+
+    Result<MergeResult> mergeInMemory(const std::string& ours, const std::string& theirs, const std::string& message);
+    Result<MergeResult> cherryPickInMemory(const std::string& commit, const std::string& onto);
+    Result<MergeResult> mergeTree(const std::string& ours, const std::string& theirs);
+    Result<MergeResult> cherryPick(const std::string& commit, const std::string& branchName);
+
+    Result<MigrateReport> migrateObjects();
+    Result<FsmonitorState> fsmonitor(const std::string& action);
+    Result<CloneResult> clone(const std::string& source);
+    Result<FetchResult> fetch(const std::string& source, const std::string& branchName);
+
+    //set when an interrupted write found in the journal had to be discarded
+    const Error& recoveryWarning() const { return recovery; }
+};
+
+} //namespace minigit
+
+#endif
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Commits can be named by a unique prefix of their hash. A prefix shared by two commits
+# is rejected as ambiguous and lists both, a shorter one than four digits is unknown,
+# and a branch name wins over a hash prefix.
+# usage: tests/abbreviated_hashes.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mg init > /dev/null
+echo a > a.txt
+mg add a.txt > /dev/null
+mg commit -m one > /dev/null
+echo b > b.txt
+mg add b.txt > /dev/null
+mg commit -m two > /dev/null
+one=$(mg log | sed -n 's/^Commit Hash: //p' | tail -1)
+two=$(mg log | sed -n 's/^Commit Hash: //p' | head -1)
+
+mg diff --name-status "${one:0:6}" "${two:0:6}" | grep -q "^A	b.txt" || fail "unique prefixes do not resolve"
+mg diff --name-status "${one:0:3}" HEAD | grep -q "unknown commit" || fail "a three-digit prefix was accepted"
+
+#a second commit sharing the first six digits of "one"; the commit index is rebuilt to list it
+digit=${one:6:1}
+[ "$digit" = "f" ] && other=e || other=f
+twin="${one:0:6}$other${one:7}"
+cp ".minigit/commits/$one.txt" ".minigit/commits/$twin.txt"
+rm -f .minigit/commits.idx .minigit/commits.idx.log
+
+out=$(mg diff --name-status "${one:0:6}" HEAD)
+echo "$out" | grep -q "is ambiguous" || fail "a shared prefix was not reported as ambiguous: $out"
+echo "$out" | grep -q "$one" && echo "$out" | grep -q "$twin" || fail "the ambiguity does not list both commits: $out"
+mg diff --name-status "${one:0:7}" HEAD | grep -q "^A	b.txt" || fail "a longer prefix does not pick the commit"
+
+#a branch named like a prefix is the branch
+mg branch "${one:0:6}" > /dev/null
+mg diff --name-status "${one:0:6}" "$one" | grep -q "A	b.txt" && fail "the prefix was read as a hash, not the branch"
+mg diff --name-status "$one" "${one:0:6}" | grep -q "^A	b.txt" || fail "the branch name does not resolve"
+
+echo "PASS"
@@ -0,0 +1,69 @@
+#!/bin/bash
+# clone copies every branch and checks out the remote HEAD; fetch sends only what the
+# local side does not already have, fast-forwards when that loses nothing and otherwise
+# leaves the fetched tip in FETCH_HEAD. A pack with a malformed commit stores nothing.
+# usage: tests/clone_fetch.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mkdir upstream local
+cd "$WORK/upstream"
+mg init > /dev/null
+echo a > a.txt
+mg add a.txt > /dev/null
+mg commit -m one > /dev/null
+echo b > b.txt
+mg add b.txt > /dev/null
+mg commit -m two > /dev/null
+mg branch side > /dev/null
+
+cd "$WORK/local"
+out=$(mg clone "$WORK/upstream")
+echo "$out" | grep -q "^Received 2 commits and 2 objects" || fail "clone did not receive the whole history: $out"
+echo "$out" | grep -q "^Cloned 2 branches" || fail "clone did not copy both branches: $out"
+echo "$out" | grep -q "^Switched to branch 'main'" || fail "clone did not check out the remote HEAD: $out"
+[ "$(cat a.txt b.txt)" = "$(printf 'a\nb')" ] || fail "the cloned working tree is wrong"
+mg fetch "$WORK/upstream" main | grep -q "^Received 0 commits and 0 objects" || fail "an up-to-date fetch resent data"
+
+#only the new commit and its new blob travel
+cd "$WORK/upstream"
+echo c > c.txt
+mg add c.txt > /dev/null
+mg commit -m three > /dev/null
+three=$(mg log | sed -n 's/^Commit Hash: //p' | head -1)
+cd "$WORK/local"
+out=$(mg fetch "$WORK/upstream" main)
+echo "$out" | grep -q "^Received 1 commits and 1 objects" || fail "fetch did not negotiate away known commits: $out"
+echo "$out" | grep -q "^Branch 'main' updated to $three" || fail "fetch did not fast-forward: $out"
+mg log | grep -q "Message: *three$" || fail "the fetched commit is not in the local history"
+
+#local and remote both moved on: the branch stays, FETCH_HEAD gets the remote tip
+echo local > l.txt
+mg add l.txt > /dev/null
+mg commit -m mine > /dev/null
+mine=$(mg log | sed -n 's/^Commit Hash: //p' | head -1)
+cd "$WORK/upstream"
+echo d > d.txt
+mg add d.txt > /dev/null
+mg commit -m four > /dev/null
+four=$(mg log | sed -n 's/^Commit Hash: //p' | head -1)
+cd "$WORK/local"
+mg fetch "$WORK/upstream" main | grep -q "has diverged" || fail "a diverged fetch moved the branch"
+[ "$(cat .minigit/refs/main)" = "$mine" ] || fail "the local branch lost its commit"
+[ "$(cat .minigit/FETCH_HEAD)" = "$four" ] || fail "FETCH_HEAD does not hold the fetched tip"
+mg fetch "$WORK/upstream" nosuch | grep -q "remote has no branch 'nosuch'" || fail "a missing branch was not reported"
+
+#a commit the clone cannot parse rejects the whole pack
+mkdir "$WORK/broken" "$WORK/copy"
+cp -r "$WORK/upstream/.minigit" "$WORK/broken/"
+printf 'MGCB\x09' | dd of="$WORK/broken/.minigit/commits/$four.txt" bs=1 count=5 conv=notrunc 2> /dev/null
+cd "$WORK/copy"
+mg clone "$WORK/broken" | grep -q "commit $four in the pack is malformed" || fail "a malformed commit was accepted"
+[ -d .minigit/commits ] && [ -n "$(ls .minigit/commits)" ] && fail "a rejected pack left commits behind"
+
+echo "PASS"
@@ -0,0 +1,50 @@
+#!/bin/bash
+# Writers running at the same time take turns on the repository lock: no staged file,
+# commit or branch is lost, and nothing is left half written afterwards.
+# usage: tests/concurrent_writers.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+WORKERS=6
+ROUNDS=5
+
+mg init > /dev/null
+
+#every worker stages and commits its own files; a commit may take other workers' files too
+for w in $(seq 1 $WORKERS); do
+    (
+        for r in $(seq 1 $ROUNDS); do
+            echo "worker $w round $r" > "w$w-r$r.txt"
+            mg add "w$w-r$r.txt" > /dev/null
+            mg commit -m "w$w r$r" | grep -q "Index cleared" || echo "commit failed" >> "$WORK/errors"
+            mg branch "b$w-$r" > /dev/null
+        done
+    ) &
+done
+wait
+[ -e "$WORK/errors" ] && fail "$(wc -l < "$WORK/errors") commits failed"
+
+commits=$(mg log | grep -c "^Commit Hash:")
+[ "$commits" -eq $((WORKERS * ROUNDS)) ] || fail "history has $commits commits, expected $((WORKERS * ROUNDS))"
+for w in $(seq 1 $WORKERS); do
+    for r in $(seq 1 $ROUNDS); do
+        mg log | grep -q "Message: *w$w r$r$" || fail "commit 'w$w r$r' was lost"
+        [ -e ".minigit/refs/b$w-$r" ] || fail "branch b$w-$r was lost"
+    done
+done
+
+#the tip holds every file, whichever commit took it
+rm -f w*-r*.txt
+restored=$(mg checkout main | grep -c "^Restored: ")
+[ "$restored" -eq $((WORKERS * ROUNDS)) ] || fail "the tip restores $restored files, expected $((WORKERS * ROUNDS))"
+[ -n "$(mg status | sed -n '/^Changes staged/,/^Changes not staged/p' | grep "^  ")" ] && fail "files were left staged"
+
+[ -e .minigit/journal ] && fail "a journal was left behind"
+[ -n "$(find .minigit -name '*.tmp')" ] && fail "temp files were left behind"
+mg fsck | grep -q " 0 problems" || fail "fsck finds problems"
+
+echo "PASS"
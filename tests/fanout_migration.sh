@@ -0,0 +1,39 @@
+#!/bin/bash
+# Objects stored flat in .minigit/objects (the layout before fan-out directories) are
+# still read, and migrate-objects moves every one of them into objects/<first two hex>/.
+# usage: tests/fanout_migration.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mg init > /dev/null
+for i in 1 2 3 4 5 6; do echo "file $i" > "f$i.txt"; done
+mg add f1.txt f2.txt f3.txt f4.txt f5.txt f6.txt > /dev/null
+mg commit -m one > /dev/null
+
+#flatten the store the way an old repository kept it
+for object in .minigit/objects/??/*; do mv "$object" .minigit/objects/; done
+rmdir .minigit/objects/??
+[ "$(find .minigit/objects -mindepth 2 -type f | wc -l)" -eq 0 ] || fail "could not flatten the object store"
+
+rm f3.txt
+mg checkout main | grep -q "Restored: f3.txt" || fail "a flat object cannot be read"
+[ "$(cat f3.txt)" = "file 3" ] || fail "a flat object was restored with the wrong content"
+
+mg migrate-objects | grep -q "^Migrated 6 of 6 objects" || fail "migrate-objects did not move every object"
+[ "$(find .minigit/objects -maxdepth 1 -type f | wc -l)" -eq 0 ] || fail "flat objects are left after migrating"
+for object in .minigit/objects/*/*; do
+    name=$(basename "$object")
+    [ "$(basename "$(dirname "$object")")" = "${name:0:2}" ] || fail "$name is in the wrong fan-out directory"
+done
+mg migrate-objects | grep -q "already uses the fan-out layout" || fail "a second migration found work to do"
+
+rm f5.txt
+mg checkout main | grep -q "Restored: f5.txt" || fail "a migrated object cannot be read"
+mg fsck | grep -q " 0 problems" || fail "fsck finds problems after migrating"
+
+echo "PASS"
@@ -0,0 +1,72 @@
+#!/bin/bash
+# A write group whose journal was completed before a crash is published by the next
+# writer; one whose journal is unfinished, or whose temp files are torn, is thrown away
+# with a warning and publishes nothing.
+# usage: tests/journal_recovery.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" 2> "$WORK/stderr" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+#the journal checksum of a text is its blob id, so a scratch repository computes it
+checksum(){
+    local scratch
+    scratch=$(mktemp -d "$WORK/hash.XXXX")
+    (cd "$scratch" && echo init | "$MG" > /dev/null && printf '%s' "$1" > f && echo "add f" | "$MG") |
+        sed -n 's/.*Added blob: //p'
+}
+
+mkdir repo
+cd repo
+mg init > /dev/null
+echo a > a.txt
+mg add a.txt > /dev/null
+mg commit -m one > /dev/null
+head=$(mg log | sed -n 's/^Commit Hash: //p')
+
+#a crash after the journal was synced: the object and the ref only exist as temp files
+blob=$(checksum "recovered")
+mkdir -p ".minigit/objects/${blob:0:2}"
+printf '%s' "recovered" > ".minigit/objects/${blob:0:2}/$blob.tmp"
+printf '%s' "$head" > .minigit/refs/rescued.tmp
+{
+    echo "minigit-journal 1"
+    printf 'obj\t%s\t%s\n' "$blob" ".minigit/objects/${blob:0:2}/$blob"
+    printf 'ref\t%s\t%s\n' "$(checksum "$head")" ".minigit/refs/rescued"
+    echo "end"
+} > .minigit/journal
+
+mg branch later > /dev/null
+[ -e .minigit/journal ] && fail "the journal was left behind after replay"
+[ "$(cat .minigit/refs/rescued 2>/dev/null)" = "$head" ] || fail "the journaled ref was not published"
+[ -e ".minigit/objects/${blob:0:2}/$blob" ] || fail "the journaled object was not published"
+grep -q "warning" "$WORK/stderr" && fail "a complete journal was reported as discarded"
+mg checkout rescued | grep -q "Restored: a.txt" || fail "the replayed branch cannot be checked out"
+
+#a crash before the journal was finished: nothing of the group may appear
+printf '%s' "$head" > .minigit/refs/lost.tmp
+{
+    echo "minigit-journal 1"
+    printf 'ref\t%s\t%s\n' "$(checksum "$head")" ".minigit/refs/lost"
+} > .minigit/journal
+mg branch other > /dev/null
+grep -q "warning: discarded an interrupted write" "$WORK/stderr" || fail "no warning for an unfinished journal"
+[ -e .minigit/refs/lost ] && fail "a ref from an unfinished journal was published"
+[ -e .minigit/refs/lost.tmp ] && fail "the temp file of an unfinished journal was left behind"
+
+#a finished journal whose temp file does not match its checksum is torn
+printf '%s' "torn" > .minigit/refs/torn.tmp
+{
+    echo "minigit-journal 1"
+    printf 'ref\t%s\t%s\n' "$(checksum "$head")" ".minigit/refs/torn"
+    echo "end"
+} > .minigit/journal
+mg branch third > /dev/null
+grep -q "warning: discarded an interrupted write" "$WORK/stderr" || fail "no warning for a torn temp file"
+[ -e .minigit/refs/torn ] && fail "a torn ref was published"
+
+mg fsck | grep -q " 0 problems" || fail "fsck finds problems after recovery"
+
+echo "PASS"
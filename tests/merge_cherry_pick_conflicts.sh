@@ -0,0 +1,78 @@
+#!/bin/bash
+# merge-tree and cherry-pick work in memory: a clean result is one new commit (which
+# cherry-pick puts on the branch), a conflict lists the paths and writes nothing. The
+# working tree, HEAD and, for merge-tree, the refs are never touched.
+# usage: tests/merge_cherry_pick_conflicts.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+commits(){ ls .minigit/commits | wc -l; }
+
+mg init > /dev/null
+echo base > a.txt
+echo base > b.txt
+echo base > c.txt
+mg add a.txt b.txt c.txt > /dev/null
+mg commit -m base > /dev/null
+mg branch side > /dev/null
+mg branch other > /dev/null
+
+echo main > a.txt
+mg add a.txt > /dev/null
+mg commit -m "main edits a" > /dev/null
+
+mg checkout side > /dev/null
+echo side > a.txt
+mg add a.txt > /dev/null
+mg commit -m "side edits a" > /dev/null
+sideA=$(cat .minigit/refs/side)
+echo side > b.txt
+mg add b.txt > /dev/null
+mg commit -m "side edits b" > /dev/null
+sideB=$(cat .minigit/refs/side)
+
+mg checkout other > /dev/null
+echo other > c.txt
+mg add c.txt > /dev/null
+mg commit -m "other edits c" > /dev/null
+mg checkout main > /dev/null
+main=$(cat .minigit/refs/main)
+
+#conflicting merge: the path is reported and nothing is written
+before=$(commits)
+out=$(mg merge-tree main side)
+echo "$out" | grep -q "^CONFLICT: a.txt" || fail "merge-tree did not report the conflict: $out"
+echo "$out" | grep -q "Merge commit" && fail "a conflicting merge-tree wrote a commit"
+[ "$(commits)" -eq "$before" ] || fail "a conflicting merge-tree stored a commit"
+
+#clean merge: one commit with both sides, no ref moves
+out=$(mg merge-tree main other)
+merged=$(echo "$out" | sed -n 's/^Merge commit: //p')
+[ -n "$merged" ] || fail "merge-tree of disjoint changes did not produce a commit: $out"
+[ "$(cat .minigit/refs/main)" = "$main" ] || fail "merge-tree moved the branch"
+[ "$(mg diff --name-status main "$merged")" = "M	c.txt" ] || fail "the merge lacks the other side's change"
+[ "$(mg diff --name-status other "$merged")" = "M	a.txt" ] || fail "the merge lacks our side's change"
+[ "$(cat a.txt c.txt)" = "$(printf 'main\nbase')" ] || fail "merge-tree touched the working tree"
+
+#conflicting cherry-pick: aborted, the branch stays
+before=$(commits)
+out=$(mg cherry-pick "$sideA")
+echo "$out" | grep -q "^CONFLICT: a.txt" || fail "cherry-pick did not report the conflict: $out"
+echo "$out" | grep -q "aborted, nothing was written" || fail "a conflicting cherry-pick was not aborted: $out"
+[ "$(cat .minigit/refs/main)" = "$main" ] || fail "an aborted cherry-pick moved the branch"
+[ "$(commits)" -eq "$before" ] || fail "an aborted cherry-pick stored a commit"
+
+#clean cherry-pick onto the current branch and onto a named one
+picked=$(mg cherry-pick "$sideB" | sed -n 's/^Cherry-picked .* as //p')
+[ -n "$picked" ] || fail "a clean cherry-pick failed"
+[ "$(cat .minigit/refs/main)" = "$picked" ] || fail "cherry-pick did not advance the current branch"
+[ "$(mg diff --name-status "$main" "$picked")" = "M	b.txt" ] || fail "cherry-pick applied more than the commit's change"
+[ "$(cat b.txt)" = "base" ] || fail "cherry-pick touched the working tree"
+mg cherry-pick "$sideB" other | grep -q "^Cherry-picked" || fail "cherry-pick onto a named branch failed"
+mg diff --name-status main other | grep -q "b.txt" && fail "the named branch did not get the change"
+
+echo "PASS"
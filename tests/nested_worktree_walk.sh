@@ -0,0 +1,28 @@
+#!/bin/bash
+# A linked worktree created inside the main working tree is not part of it:
+# status does not list its files and "add ." does not stage them.
+# usage: tests/nested_worktree_walk.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mg init > /dev/null
+echo a > a.txt
+mg add a.txt > /dev/null
+mg commit -m one > /dev/null
+mg branch side > /dev/null
+mg worktree add wt side | grep -q "created" || fail "could not create the worktree"
+[ -e wt/.minigit ] || fail "the worktree has no .minigit entry"
+echo b > wt/b.txt
+
+mg status | grep -q "wt/" && fail "status lists files of the nested worktree"
+mg add . | grep -q "wt/" && fail "add . stages files of the nested worktree"
+mg status | grep -q "wt/" && fail "the nested worktree's files were staged"
+
+(cd wt && echo status | "$MG") | grep -q "b.txt" || fail "the worktree does not see its own files"
+
+echo "PASS"
@@ -0,0 +1,36 @@
+#!/bin/bash
+# A commit that stages only some tracked files must still carry the others:
+# "log -- <path>" lists only commits that changed the path, and diff reports no deletions.
+# usage: tests/partial_commit_history.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mg init > /dev/null
+echo a > a.txt
+echo b > b.txt
+mg add a.txt b.txt > /dev/null
+mg commit -m one > /dev/null
+echo c > c.txt
+mg add c.txt > /dev/null
+mg commit -m two > /dev/null
+
+log=$(mg log -- b.txt)
+echo "$log" | grep -q "Message: *one$" || fail "log -- b.txt misses the commit that added b.txt"
+echo "$log" | grep -q "Message: *two$" && fail "log -- b.txt lists a commit that only staged c.txt"
+
+one=$(mg log | sed -n 's/^Commit Hash: //p' | tail -1)
+diff=$(mg diff --name-status "$one" HEAD)
+echo "$diff" | grep -q "^D" && fail "diff reports a deletion: $diff"
+echo "$diff" | grep -q "^A	c.txt" || fail "diff misses the added file: $diff"
+
+rm b.txt
+mg add b.txt | grep -q "Staged removal: b.txt" || fail "removing a tracked file cannot be staged"
+mg commit -m three | grep -q "Removed: b.txt" || fail "commit does not report the removed file"
+mg log -- b.txt | grep -q "Message: *three$" || fail "log -- b.txt misses the commit that removed it"
+
+echo "PASS"
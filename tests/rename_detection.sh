@@ -0,0 +1,56 @@
+#!/bin/bash
+# diff pairs a deleted file with an added one when their contents match or are at
+# least half similar, reports a new file identical to a kept one as a copy, and leaves
+# unrelated files as plain adds and deletes. A merge carries an edit made on one side
+# over to the path the other side moved the file to.
+# usage: tests/rename_detection.sh <path to the minigit binary>
+set -u
+MG=$(realpath "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+mg(){ echo "$*" | "$MG" | sed 's/^Enter command: //'; }
+fail(){ echo "FAIL: $*"; exit 1; }
+
+mg init > /dev/null
+seq 1 20 | sed 's/^/line /' > edited.txt
+seq 1 20 | sed 's/^/row /' > exact.txt
+echo same > keep.txt
+echo gone > old.txt
+mg add edited.txt exact.txt keep.txt old.txt > /dev/null
+mg commit -m base > /dev/null
+base=$(cat .minigit/refs/main)
+mg branch side > /dev/null
+
+mv exact.txt exact-moved.txt
+mv edited.txt edited-moved.txt
+sed -i 's/^line 7$/line seven/' edited-moved.txt
+cp keep.txt copy.txt
+rm old.txt
+echo fresh > new.txt
+mg add exact.txt exact-moved.txt edited.txt edited-moved.txt copy.txt old.txt new.txt > /dev/null
+mg commit -m moves > /dev/null
+
+out=$(mg diff --name-status "$base" HEAD)
+echo "$out" | grep -q "^R100	exact.txt	exact-moved.txt$" || fail "an exact rename was not found: $out"
+echo "$out" | grep -qE "^R0(5[0-9]|[6-9][0-9])	edited.txt	edited-moved.txt$" ||
+    fail "a rename with an edit was not found: $out"
+echo "$out" | grep -q "^C100	keep.txt	copy.txt$" || fail "a copy of a kept file was not found: $out"
+echo "$out" | grep -q "^D	old.txt$" || fail "an unrelated delete was paired: $out"
+echo "$out" | grep -q "^A	new.txt$" || fail "an unrelated add was paired: $out"
+[ "$(echo "$out" | wc -l)" -eq 5 ] || fail "diff lists more than the five changes: $out"
+mg diff --stat "$base" HEAD | grep -q "edited.txt => edited-moved.txt | 2 +-" || fail "--stat does not count the rename's edit"
+
+#side edits the file main moved away without changing it
+mg checkout side > /dev/null
+sed -i 's/^row 15$/row fifteen/' exact.txt
+mg add exact.txt > /dev/null
+mg commit -m "side edits" > /dev/null
+mg checkout main > /dev/null
+merged=$(mg merge-tree main side | sed -n 's/^Merge commit: //p')
+[ -n "$merged" ] || fail "merging an edit into a renamed file conflicted"
+[ "$(mg diff --name-status main "$merged")" = "M	exact-moved.txt" ] || fail "the edit did not follow the rename"
+[ "$(mg diff --name-status side "$merged" | grep exact)" = "R100	exact.txt	exact-moved.txt" ] ||
+    fail "the merge did not keep the moved path with side's content"
+
+echo "PASS"